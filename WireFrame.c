@@ -3,20 +3,74 @@
  *  Date:        November 4th, 2013
  *  File name:   WireFrame.c
  *  Description: Generate HTML5 and SVG code to display wire frame.
- *               The wire frame is specified in an input text file identified WIREFRAME_INPUT_FILENAME.
+ *               The wire frame is specified in an input text file identified WIREFRAME_INPUT_FILENAME,
+ *               or in an OBJ, PLY or STL mesh.
  *               The HTML5/SVG code is output into a text file identified by HTML5_SVG_OUTPUT_FILENAME.
+ *               Either may be replaced by a pipe, named "-" (STREAM_FILENAME).
  */
 
+#ifdef WIREFRAME_ZLIB
+#define _GNU_SOURCE  // for fopencookie
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <math.h>
 #include <stdbool.h>
+#include <float.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#ifdef WIREFRAME_ZLIB
+#include <zlib.h>
+#endif
 
 //The name of the input file
 #define WIREFRAME_INPUT_FILENAME ("input.txt")
 // The name of the output file
 #define HTML5_SVG_OUTPUT_FILENAME ("output.html")
+// The file name that stands for standard input or standard output
+#define STREAM_FILENAME ("-")
+// Size of the buffers given to the input and output streams
+#define STREAM_BUFFER_SIZE (1 << 20)
+// Output files with this suffix are gzip compressed (input files are recognised by content)
+#define COMPRESSED_SUFFIX (".gz")
+// Size of the blocks zlib inflates and deflates at a time, and the deflate level (1-9)
+#define COMPRESSION_BLOCK_SIZE (128*1024)
+#define COMPRESSION_LEVEL (6)
+// Directory holding previously rendered outputs, keyed by a hash of the input and views
+#define RENDER_CACHE_DIR ("render_cache")
+// Once the cache grows past this many bytes, the least recently used renders are evicted
+#define RENDER_CACHE_MAX_BYTES (64L*1024*1024)
+// Set to true to cache renders without --cache
+#define RENDER_CACHE_ENABLED (false)
+// Bump whenever the output format changes so that stale renders are never served
+#define RENDER_CACHE_VERSION (1)
+// The parsed edges of an input file are snapshotted next to it in a file with this suffix
+#define GEOMETRY_CACHE_SUFFIX (".wfc")
+// Set to true to snapshot input files without --geometry-cache
+#define GEOMETRY_CACHE_ENABLED (false)
+// Set to false to format edge coordinates with printf rather than from integer tenths
+#define FIXED_POINT_OUTPUT_ENABLED (true)
+// Room for one formatted <line> element; longer colours fall back to printf
+#define EDGE_LINE_MAX (512)
 
 /* ========================================================================= */
 /*                              Type Definitions                             */
@@ -37,193 +91,4229 @@
 #define ROTATION_ANGLE_Z (-45*(M_PI/180)) //i.e. 45 degrees
 
 #define MATRIX_MAX (4)
-#define MAX_WIREFRAME_EDGES (5000)
+#define INITIAL_WIREFRAME_EDGES (4096)  // the edge array grows beyond this as needed
+// Number of simplified levels of detail built for --lod, each with half the grid resolution
+// of the one before, starting from LOD_FINEST_RESOLUTION cells across the model
+#define LOD_LEVELS (5)
+#define LOD_FINEST_RESOLUTION (1024)
+// A view uses the coarsest level whose merged vertices move by at most this many pixels
+#define LOD_PIXEL_THRESHOLD (0.5)
 #define POINTS_PER_EDGE  (6)
 
 typedef float Matrix[MATRIX_MAX][MATRIX_MAX];
 
+// Axis-aligned bounding box of a wire frame
+typedef struct {
+	float min[3];
+	float max[3];
+} Bounds;
+
+// A simplified copy of a wire frame, in which vertices that share a grid cell
+// have been merged and the edges between them dropped
+typedef struct {
+	float cellSize;      // side of the grid cells, in model units
+	Matrix *wireFrame;
+	int noEdges;
+} DetailLevel;
+
+// The levels of detail of a wire frame, from finest to coarsest
+typedef struct {
+	DetailLevel levels[LOD_LEVELS];
+	int noLevels;
+} DetailHierarchy;
+
+// A wire frame with shared vertices: each edge joins two entries of vertices
+typedef struct {
+	float (*vertices)[3];
+	int noVertices;
+	int (*edges)[2];
+	int noEdges;
+} IndexedMesh;
+
+// A wire frame with shared vertices, each stored as three 16-bit steps from the
+// centre of the model's bounding box: vertex v is at origin + step*vertices[v]
+typedef struct {
+	float origin[3];
+	float step[3];           // model units per step along each axis
+	int16_t (*vertices)[3];
+	int noVertices;
+	int (*edges)[2];
+	int noEdges;
+} QuantizedMesh;
+
+// The faces of a mesh, rebuilt from its edges, and the faces either side of each edge
+typedef struct {
+	int noFaces;
+	float (*normals)[3];   // outward unit normal of each face
+	int (*edgeFaces)[2];   // for each edge of the wire frame, the faces either side (-1 if none
+	                       // or if the edge belongs to an open patch of faces)
+} FaceAdjacency;
+
+// The connectivity of a wire frame: its distinct vertices, its distinct undirected
+// edges and, in compressed rows, the neighbours of each vertex. Those of vertex v
+// are neighbour[first[v]] .. neighbour[first[v+1]-1], reached along the distinct
+// edges edge[first[v]] .. edge[first[v+1]-1].
+typedef struct {
+	IndexedMesh mesh;      // the vertices, and the vertices at the ends of each edge of the wire frame
+	int noDistinct;
+	int (*ends)[2];        // the vertices of each distinct edge, the smaller first
+	int *distinctOf;       // the distinct edge of each edge of the wire frame, -1 if it is a point
+	int *first;
+	int *neighbour;
+	int *edge;
+} EdgeGraph;
+
+#define MODEL_NAME_MAX (256)
+
+// A wire frame as loaded from a file, together with everything derived from it
+typedef struct {
+	char name[MODEL_NAME_MAX];
+	off_t size;               // size of the file when it was loaded
+	struct timespec mtime;    // modification time of the file when it was loaded
+	Matrix *wireFrame;
+	int noEdges;
+	int noDuplicates;         // edges removed as duplicates, if deduplicateEdges
+	Bounds bounds;
+	DetailHierarchy lod;      // levels of detail, if useDetailLevels
+	EdgeGraph graph;          // connectivity of the edges, if anything derived needs it
+	int noParts;              // connected parts, if splitParts; 0 otherwise
+	int *partStart;           // the edges of part p are partStart[p] .. partStart[p+1]-1
+	FaceAdjacency faces;      // faces either side of each edge, if cullBackFaces
+	QuantizedMesh quantized;  // the edges, if quantizeVertices (wireFrame is then NULL)
+} Model;
+
+// One rendering of the wire frame: its orientation, where it is placed on the canvas
+// and in which colour
+typedef struct {
+	float rx, ry, rz;  // rotations about the x, y and z axes (in radians)
+	float scale;       // uniform scaling factor
+	float xt, yt, zt;  // translation applied after scaling
+	char *colour;      // stroke colour of the edges
+} View;
+
+// The default layout, used unless a view file is given with --views
+#define NUM_VIEWS (4)
+View views[NUM_VIEWS] = {
+	{ROTATION_ANGLE_X, ROTATION_ANGLE_Y, ROTATION_ANGLE_Z, 200, 125, 0, 125, OBJECT_COLOR_0},
+	{ROTATION_ANGLE_X, ROTATION_ANGLE_Y, ROTATION_ANGLE_Z, 150, 375, 0, 125, OBJECT_COLOR_1},
+	{ROTATION_ANGLE_X, ROTATION_ANGLE_Y, ROTATION_ANGLE_Z, 100, 125, 0, 375, OBJECT_COLOR_2},
+	{ROTATION_ANGLE_X, ROTATION_ANGLE_Y, ROTATION_ANGLE_Z,  50, 375, 0, 375, OBJECT_COLOR_3},
+};
+
+// Size of the SVG canvas; a view file may change it
+int canvasWidth = CANVAS_SIZE_X;
+int canvasHeight = CANVAS_SIZE_Y;
+
+// When true, drawWireframe also prints every transformed edge to stdout
+bool echoTransformedEdges = true;
+// When true, main serves renders from RENDER_CACHE_DIR and saves them there
+bool useRenderCache = RENDER_CACHE_ENABLED;
+// When true, readWireFrame loads and saves geometry snapshots
+bool useGeometryCache = GEOMETRY_CACHE_ENABLED;
+// When true, writeEdge rounds coordinates to integer tenths and formats them by table
+bool fixedPointOutput = FIXED_POINT_OUTPUT_ENABLED;
+// When true, writeEdge writes well-formed XML for a standalone SVG document;
+// the HTML output keeps the comma after x2 that HTML parsers skip over
+bool standaloneSVG = false;
+// When true, edges listed more than once (in either direction) are drawn only once
+bool deduplicateEdges = false;
+// When true, views drawn at small scales use simplified levels of detail
+bool useDetailLevels = false;
+// When true, drawWireframe skips edges that are zero-length or repeated at output precision
+bool cullSubpixelEdges = false;
+// When true, faces are rebuilt from the edges and edges between two back faces are skipped
+bool cullBackFaces = false;
+// When true, models' edges are put in the Morton order of their midpoints after loading
+bool reorderEdges = false;
+// When true, drawProjected merges chains of collinear edges into single lines
+bool mergeCollinear = false;
+// When true, drawProjected simplifies chains of edges to within SIMPLIFY_TOLERANCE pixels
+bool simplifyChains = false;
+// When true, each connected part of a model is drawn in an SVG group of its own
+bool splitParts = false;
+// When true, models keep their vertices as 16-bit steps across their bounds
+bool quantizeVertices = false;
+// When true, openOutput gzip compresses what is written (needs a build with -DWIREFRAME_ZLIB)
+bool compressOutput = false;
+// When true, views that share a rotation share one copy of the SVG geometry
+bool shareViewGeometry = false;
+// When true, each view's SVG lines are grouped in a <g> that sets their stroke once
+bool groupStrokes = false;
+
+// The kinds of document that can be written: SVG with an element per edge, or a
+// canvas drawn by a script from the projected edges packed as base64 floats
+typedef enum {OUTPUT_SVG, OUTPUT_CANVAS} OutputFormat;
+OutputFormat outputFormat = OUTPUT_SVG;
+
+/* ========================================================================= */
+/*                              Instrumentation                              */
+/*    Compile with -DWIREFRAME_PROFILE to time each stage of the pipeline    */
+/*    and count the edges it handles. The totals are written to stderr at    */
+/*    exit, as a table or, if WIREFRAME_PROFILE_FORMAT=json is set in the    */
+/*    environment, as JSON. Without the flag every macro compiles away.      */
+/* ========================================================================= */
+
+typedef enum {
+	STAGE_READ,       // readWireFrame
+	STAGE_ROTATE,     // rotateWireFrame and rotateQuantizedMesh, once per rotation
+	STAGE_PROJECT,    // projectRotated, the scale and offset of each view
+	STAGE_STREAM,     // the per-edge matMul in drawWireframe, for edges drawn as they arrive
+	STAGE_EMIT,       // writeEdge
+	NUM_STAGES
+} ProfileStage;
+
+typedef enum {
+	COUNTER_EDGES_PARSED,       // edges parsed from text input
+	COUNTER_EDGES_SNAPSHOT,     // edges loaded from a geometry snapshot
+	COUNTER_EDGES_DUPLICATE,    // duplicate edges removed after loading
+	COUNTER_EDGES_TRANSFORMED,  // edge transforms, summed over all views
+	COUNTER_EDGES_CULLED,       // edges dropped before they were written
+	COUNTER_BYTES_EMITTED,      // bytes of output written by writeEdge
+	NUM_COUNTERS
+} ProfileCounter;
+
+#ifdef WIREFRAME_PROFILE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+const char *profileStageNames[NUM_STAGES] = {
+	"readWireFrame", "rotate", "project (scale+offset)", "stream matMul", "writeEdge"
+};
+const char *profileCounterNames[NUM_COUNTERS] = {
+	"edges parsed", "edges from snapshot", "duplicate edges", "edges transformed", "edges culled", "bytes emitted"
+};
+
+uint64_t profileTicks[NUM_STAGES];
+uint64_t profileCalls[NUM_STAGES];
+uint64_t profileCounters[NUM_COUNTERS];
+uint64_t profileStartTicks;
+struct timespec profileStartTime;
+
+/* profileNow
+   Returns the current time in ticks: TSC cycles on x86, nanoseconds elsewhere.
+*/
+static inline uint64_t profileNow(void){
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+#endif
+} /* profileNow */
+
+/* profileReport
+   Writes the stage timings and counters to stderr. Ticks are converted to
+   seconds using the tick rate observed since profileInit.
+*/
+void profileReport(void){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = (now.tv_sec - profileStartTime.tv_sec) + (now.tv_nsec - profileStartTime.tv_nsec)*1e-9;
+	uint64_t elapsedTicks = profileNow() - profileStartTicks;
+	double secondsPerTick = elapsedTicks ? elapsed/elapsedTicks : 0;
+	bool json = getenv("WIREFRAME_PROFILE_FORMAT") != NULL &&
+	            strcmp(getenv("WIREFRAME_PROFILE_FORMAT"), "json") == 0;
+	int i;
+
+	if (json){
+		fprintf(stderr, "{\"total_ms\": %.3f, \"stages\": {", elapsed*1e3);
+		for (i=0; i<NUM_STAGES; i++)
+			fprintf(stderr, "%s\"%s\": {\"calls\": %" PRIu64 ", \"ms\": %.3f}", i ? ", " : "",
+			        profileStageNames[i], profileCalls[i], profileTicks[i]*secondsPerTick*1e3);
+		fprintf(stderr, "}, \"counters\": {");
+		for (i=0; i<NUM_COUNTERS; i++)
+			fprintf(stderr, "%s\"%s\": %" PRIu64, i ? ", " : "", profileCounterNames[i], profileCounters[i]);
+		fprintf(stderr, "}}\n");
+		return;
+	} /*if*/
+
+	fprintf(stderr, "%-30s %12s %12s %7s\n", "stage", "calls", "ms", "%");
+	for (i=0; i<NUM_STAGES; i++) {
+		double ms = profileTicks[i]*secondsPerTick*1e3;
+		fprintf(stderr, "%-30s %12" PRIu64 " %12.3f %6.1f%%\n", profileStageNames[i], profileCalls[i],
+		        ms, elapsed > 0 ? 100*ms/(elapsed*1e3) : 0.0);
+	} /*for*/
+	fprintf(stderr, "%-30s %12s %12.3f\n", "total", "", elapsed*1e3);
+	for (i=0; i<NUM_COUNTERS; i++)
+		fprintf(stderr, "%-30s %12" PRIu64 "\n", profileCounterNames[i], profileCounters[i]);
+} /* profileReport */
+
+/* profileInit
+   Starts the clock used to calibrate ticks and arranges for the report at exit.
+*/
+void profileInit(void){
+	clock_gettime(CLOCK_MONOTONIC, &profileStartTime);
+	profileStartTicks = profileNow();
+	atexit(profileReport);
+} /* profileInit */
+
+#define PROFILE_INIT()            profileInit()
+#define PROFILE_BEGIN(stage)      uint64_t profileStart_##stage = profileNow()
+#define PROFILE_END(stage)        (profileTicks[stage] += profileNow() - profileStart_##stage, profileCalls[stage]++)
+// A stage that is interrupted by another can be paused and resumed between its BEGIN and END
+#define PROFILE_PAUSE(stage)      (profileTicks[stage] += profileNow() - profileStart_##stage)
+#define PROFILE_RESUME(stage)     (profileStart_##stage = profileNow())
+#define PROFILE_COUNT(counter, n) (profileCounters[counter] += (n))
+
+#else
+
+#define PROFILE_INIT()            ((void)0)
+#define PROFILE_BEGIN(stage)      ((void)0)
+#define PROFILE_END(stage)        ((void)0)
+#define PROFILE_PAUSE(stage)      ((void)0)
+#define PROFILE_RESUME(stage)     ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)(n))
+
+#endif /* WIREFRAME_PROFILE */
+
+/* ========================================================================= */
+/*                       Library Function  Declarations                      */
+/*            These functions are defined at the end of the file.            */
+/* ========================================================================= */
+
+
+/* writePrologue
+   This function writes the initial part of the HTML5 file (which sets up the
+   graphics interface). This must be called before any graphical data is written
+   to the file.
+*/
+void writePrologue(FILE *f);
+
+/* writeEpilogue
+   This function writes the final part of the HTML5 file. This must be called
+   after all data has been written, but before the file is closed.
+   (The caller is responsible for closing the file afterwards).
+*/
+void writeEpilogue(FILE *f);
+
+/* writeEdge
+   This function writes an edge into the HTML5 file referenced by f.
+   The edge segment begins at point (x1,y1) and ends at point (x2,y2).
+   The edge is drawn with the specified colour.
+*/
+void writeEdge(FILE *f, float x1, float y1, float x2, float y2, char colour[]);
+
+/* projectionMatrix
+   This function sets the provided matrix to a 2x4 projection matrix, which
+   is used to convert points in 3 dimensions to points in 2 dimensions.
+*/
+
+void projectionMatrix(Matrix outM);
+
+/* rotationMatrixX
+   Sets the matrix outM to contain a 4x4 rotation matrix for a rotation
+   of the given angle (which is provided in radians) around the X axis.
+
+*/
+void rotationMatrixX(float angle, Matrix outM);
+
+/* rotationMatrixY
+   Sets the matrix outM to contain a 4x4 rotation matrix for a rotation
+   of the given angle (which is provided in radians) around the Y axis.
+*/
+
+void rotationMatrixY(float angle, Matrix outM);
+
+/* rotationMatrixZ
+   Sets the matrix outM to contain a 4x4 rotation matrix for a rotation
+   of the given angle (which is provided in radians) around the Z axis.
+
+*/
+void rotationMatrixZ(float angle, Matrix outM);
+
+/* scalingMatrix
+   Sets the matrix outM to contain a 4x4 scaling matrix where the three
+   scaling factors are xs, ys, zs.
+
+*/
+void scalingMatrix(float xs, float ys, float zs, Matrix outM);
+
+/* translationMatrix
+   Sets the matrix outM to contain a 4x4 translation matrix where the three
+   translation factors are xt, yt, zt.
+
+*/
+void translationMatrix(float xt, float yt, float zt, Matrix outM);
+
+/* readWireFrame
+   Reads a wireframe from the file fileName.  The wireframe is returned via
+   parameter wireFrame, in an array allocated with malloc which the caller must
+   free.  The function returns the number of edges in the wireframe.  Unless
+   bounds is NULL, the bounding box of the wireframe is returned through it. If the file is unchanged since it was last parsed, the
+   edges are loaded from its geometry snapshot instead of being parsed again.
+   Files named *.obj, *.ply or *.stl are imported as meshes, each distinct
+   side of their faces becoming an edge; anything else is read as a list of
+   edges, six coordinates each. If fileName is STREAM_FILENAME, the edges are
+   read from standard input.
+*/
+int readWireFrame(const char *fileName, Matrix **wireFrame, Bounds *bounds);
+
+// The formats readWireFrame understands, chosen by the extension of the file name
+typedef enum {MESH_FORMAT_EDGES, MESH_FORMAT_OBJ, MESH_FORMAT_PLY, MESH_FORMAT_STL} MeshFormat;
+
+/* meshFormat
+   Returns the format readWireFrame reads fileName in, judged by its extension.
+*/
+MeshFormat meshFormat(const char *fileName);
+
+/* parseWireFrame
+   Parses edges from inFile, which was opened from fileName, until it ends.
+   They are returned as readWireFrame returns them. If outFile is not NULL,
+   each edge is also drawn in view to outFile as soon as it is read, so that
+   output can start before the input is exhausted.
+*/
+int parseWireFrame(FILE *inFile, const char *fileName, Matrix **wireFrame, Bounds *bounds,
+                   FILE *outFile, View *view);
+
+/* ========================================================================= */
+/*                                Load Errors                                */
+/*    A model that cannot be read is normally fatal. The render server       */
+/*    instead loads through tryLoadModel, which sets loadRecovery, so that   */
+/*    loadFailed returns there and the server can answer with an error.      */
+/* ========================================================================= */
+
+#define LOAD_ERROR_MAX (256)
+
+// Where loadFailed returns to, or NULL if a failure to load should exit
+jmp_buf *loadRecovery = NULL;
+// Why the last load failed
+char loadError[LOAD_ERROR_MAX];
+
+/* loadFailed
+   Reports, printf style, why a model could not be loaded. Exits, unless
+   loadRecovery is set, in which case the reason is kept in loadError and
+   control returns to loadRecovery.
+*/
+void loadFailed(const char *format, ...){
+	va_list args;
+	va_start(args, format);
+	vsnprintf(loadError, sizeof(loadError), format, args);
+	va_end(args);
+	printf("Error: %s\n", loadError);
+	if (loadRecovery != NULL) longjmp(*loadRecovery, 1);
+	exit(EXIT_FAILURE);
+} /* loadFailed */
+
+/* ========================================================================= */
+/*                            Compressed Streams                             */
+/*    Compile with -DWIREFRAME_ZLIB and link with -lz to read gzip input     */
+/*    and write gzip output. zlib is wrapped in an ordinary FILE, so the     */
+/*    parsers and writers are unaware of it; it inflates and deflates        */
+/*    COMPRESSION_BLOCK_SIZE bytes at a time as the stream is used.          */
+/* ========================================================================= */
+
+/* hasCompressedSuffix
+   Returns whether fileName ends in COMPRESSED_SUFFIX.
+*/
+bool hasCompressedSuffix(const char *fileName){
+	size_t length = strlen(fileName), suffix = strlen(COMPRESSED_SUFFIX);
+	return length > suffix && strcasecmp(fileName + length - suffix, COMPRESSED_SUFFIX) == 0;
+} /* hasCompressedSuffix */
+
+#ifdef WIREFRAME_ZLIB
+ssize_t gzipRead(void *cookie, char *buf, size_t size){
+	if (size > INT32_MAX) size = INT32_MAX;
+	return gzread((gzFile)cookie, buf, size);
+} /* gzipRead */
+
+ssize_t gzipWrite(void *cookie, const char *buf, size_t size){
+	if (size > INT32_MAX) size = INT32_MAX;
+	return gzwrite((gzFile)cookie, buf, size);
+} /* gzipWrite */
+
+int gzipSeek(void *cookie, off64_t *offset, int whence){
+	z_off_t position = gzseek((gzFile)cookie, *offset, whence);
+	if (position < 0) return -1;
+	*offset = position;
+	return 0;
+} /* gzipSeek */
+
+int gzipClose(void *cookie){
+	return gzclose((gzFile)cookie) == Z_OK ? 0 : -1;
+} /* gzipClose */
+
+/* gzipStream
+   Returns a FILE that reads or writes (as mode is "r" or "w") through the
+   zlib stream on file descriptor fd, which it takes over. Returns NULL on
+   failure.
+*/
+FILE *gzipStream(int fd, const char *mode){
+	char gzipMode[8];
+	snprintf(gzipMode, sizeof(gzipMode), "%sb%d", mode, COMPRESSION_LEVEL);
+	gzFile gz = fd >= 0 ? gzdopen(fd, gzipMode) : NULL;
+	if (gz == NULL){
+		if (fd >= 0) close(fd);
+		return NULL;
+	} /*if*/
+	gzbuffer(gz, COMPRESSION_BLOCK_SIZE);
+	cookie_io_functions_t functions = {gzipRead, gzipWrite, gzipSeek, gzipClose};
+	FILE *f = fopencookie(gz, mode, functions);
+	if (f == NULL){
+		gzclose(gz);
+		return NULL;
+	} /*if*/
+	setvbuf(f, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+	return f;
+} /* gzipStream */
+#endif /* WIREFRAME_ZLIB */
+
+/* openInput
+   Opens fileName for reading in the given fopen mode, or returns standard
+   input if it is STREAM_FILENAME. gzip compressed input is decompressed as it
+   is read; standard input always goes through zlib, which passes plain data
+   through unchanged. Fails through loadFailed.
+*/
+FILE *openInput(const char *fileName, const char *mode){
+	bool streamIn = strcmp(fileName, STREAM_FILENAME) == 0;
+	FILE *inFile = streamIn ? stdin : fopen(fileName, mode);
+	if (inFile == NULL) loadFailed("Unable to open input file %s", fileName);
+
+	unsigned char magic[2];
+	bool gzip = streamIn || (pread(fileno(inFile), magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b);
+#ifdef WIREFRAME_ZLIB
+	if (gzip){
+		FILE *gzipFile = gzipStream(dup(fileno(inFile)), "r");
+		if (!streamIn) fclose(inFile);
+		if (gzipFile == NULL) loadFailed("Unable to decompress input file %s", fileName);
+		inFile = gzipFile;
+	} /*if*/
+#else
+	if (gzip && !streamIn){
+		fclose(inFile);
+		loadFailed("%s is compressed; build with -DWIREFRAME_ZLIB -lz to read it", fileName);
+	} /*if*/
+#endif
+	return inFile;
+} /* openInput */
+
+/* closeInput
+   Closes a file opened by openInput.
+*/
+void closeInput(FILE *inFile){
+	if (inFile != stdin) fclose(inFile);
+} /* closeInput */
+
+/* openOutput
+   Opens outFileName for writing, or returns standard output if it is
+   STREAM_FILENAME, with a STREAM_BUFFER_SIZE buffer. If compressOutput is
+   set, what is written is gzip compressed on the way. Exits on failure.
+*/
+FILE *openOutput(const char *outFileName){
+	bool streamOut = strcmp(outFileName, STREAM_FILENAME) == 0;
+	if (compressOutput){
+#ifdef WIREFRAME_ZLIB
+		fflush(stdout);
+		int fd = streamOut ? dup(STDOUT_FILENO) : open(outFileName, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		FILE *gzipFile = gzipStream(fd, "w");
+		if (gzipFile == NULL){
+			printf("Error: Unable to open output file %s\n", outFileName);
+			exit(EXIT_FAILURE);
+		} /*if*/
+		return gzipFile;
+#else
+		printf("Error: Compressed output needs a build with -DWIREFRAME_ZLIB -lz\n");
+		exit(EXIT_FAILURE);
+#endif
+	} /*if*/
+
+	if (streamOut) return stdout;
+	FILE *outFile = fopen(outFileName, "w");
+	if (outFile == NULL){
+		printf("Error: Unable to open output file %s\n", outFileName);
+		exit(EXIT_FAILURE);
+	} /*if*/
+	setvbuf(outFile, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+	return outFile;
+} /* openOutput */
+
+/* closeOutput
+   Closes a file opened by openOutput, or just flushes it if it is standard output.
+*/
+void closeOutput(FILE *outFile){
+	if (outFile == stdout)
+		fflush(outFile);
+	else
+		fclose(outFile);
+} /* closeOutput */
+
+/* ========================================================================= */
+/*                               Canvas Output                               */
+/*    The alternative to one SVG element per edge: each view's projected    */
+/*    edges are written as a base64 string of little-endian floats (x1, y1,  */
+/*    x2, y2 per edge) and stroked onto a single canvas by a small script,   */
+/*    so the page holds a handful of nodes however large the model is.      */
+/* ========================================================================= */
+
+// The base64 encoder for the view being written; bytes wait here until there are three
+struct {
+	unsigned char pending[3];
+	int noPending;
+} canvasEncoder;
+
+/* writeBase64
+   Writes the noBytes bytes in bytes to f in base64 (padded if final), keeping
+   up to two left over in canvasEncoder for the next call.
+*/
+void writeBase64(FILE *f, const unsigned char bytes[], int noBytes, bool final){
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char out[4];
+	int i;
+	for (i=0; i<noBytes; i++) {
+		canvasEncoder.pending[canvasEncoder.noPending++] = bytes[i];
+		if (canvasEncoder.noPending < 3) continue;
+		unsigned char *p = canvasEncoder.pending;
+		out[0] = digits[p[0] >> 2];
+		out[1] = digits[(p[0] & 3) << 4 | p[1] >> 4];
+		out[2] = digits[(p[1] & 15) << 2 | p[2] >> 6];
+		out[3] = digits[p[2] & 63];
+		fwrite(out, 1, 4, f);
+		canvasEncoder.noPending = 0;
+	} /*for*/
+	if (final && canvasEncoder.noPending > 0){
+		unsigned char *p = canvasEncoder.pending;
+		if (canvasEncoder.noPending == 1) p[1] = 0;
+		out[0] = digits[p[0] >> 2];
+		out[1] = digits[(p[0] & 3) << 4 | p[1] >> 4];
+		out[2] = canvasEncoder.noPending == 2 ? digits[(p[1] & 15) << 2] : '=';
+		out[3] = '=';
+		fwrite(out, 1, 4, f);
+		canvasEncoder.noPending = 0;
+	} /*if*/
+} /* writeBase64 */
+
+/* writeCanvasPrologue
+   Writes the start of a canvas document: the page, the canvas and the script
+   function drawEdges that each view calls with its colour and edges.
+*/
+void writeCanvasPrologue(FILE *f){
+	fputs("<!DOCTYPE html>\n<html>\n<head>\n<title>CSC 111 Assignment 6 Part II</title>\n</head>\n<body>\n", f);
+	fprintf(f, "<canvas id=\"wireframe\" width=\"%d\" height=\"%d\"></canvas>\n", canvasWidth, canvasHeight);
+	fputs("<script>\n"
+	      "function drawEdges(colour, edges) {\n"
+	      "\tvar bytes = atob(edges), data = new DataView(new ArrayBuffer(bytes.length));\n"
+	      "\tfor (var i = 0; i < bytes.length; i++) data.setUint8(i, bytes.charCodeAt(i));\n"
+	      "\tvar context = document.getElementById(\"wireframe\").getContext(\"2d\");\n"
+	      "\tcontext.strokeStyle = colour;\n"
+	      "\tcontext.beginPath();\n"
+	      "\tfor (var i = 0; i + 16 <= bytes.length; i += 16) {\n"
+	      "\t\tcontext.moveTo(data.getFloat32(i, true), data.getFloat32(i + 4, true));\n"
+	      "\t\tcontext.lineTo(data.getFloat32(i + 8, true), data.getFloat32(i + 12, true));\n"
+	      "\t}\n"
+	      "\tcontext.stroke();\n"
+	      "}\n"
+	      "</script>\n", f);
+} /* writeCanvasPrologue */
+
+/* beginCanvasView
+   Starts the script that draws one view's edges in colour.
+*/
+void beginCanvasView(FILE *f, char colour[]){
+	fprintf(f, "<script>drawEdges(\"%s\", \"", colour);
+	canvasEncoder.noPending = 0;
+} /* beginCanvasView */
+
+/* writeCanvasEdge
+   Adds the edge from (x1,y1) to (x2,y2) to the view being written.
+*/
+void writeCanvasEdge(FILE *f, float x1, float y1, float x2, float y2){
+	float xy[4] = {x1, y1, x2, y2};
+	unsigned char bytes[16];
+	int i;
+	for (i=0; i<4; i++) {
+		uint32_t u;
+		memcpy(&u, &xy[i], sizeof(u));
+		bytes[4*i] = u;
+		bytes[4*i + 1] = u >> 8;
+		bytes[4*i + 2] = u >> 16;
+		bytes[4*i + 3] = u >> 24;
+	} /*for*/
+	writeBase64(f, bytes, sizeof(bytes), false);
+	PROFILE_COUNT(COUNTER_BYTES_EMITTED, sizeof(bytes)*4/3);
+} /* writeCanvasEdge */
+
+/* endCanvasView
+   Finishes the script begun by beginCanvasView.
+*/
+void endCanvasView(FILE *f){
+	writeBase64(f, NULL, 0, true);
+	fputs("\");</script>\n", f);
+} /* endCanvasView */
+
+void writeCanvasEpilogue(FILE *f){
+	fputs("</body>\n</html>\n", f);
+} /* writeCanvasEpilogue */
+
+/* writeDocumentPrologue, writeDocumentEpilogue, beginView, endView
+   Write the parts of a document in outputFormat. Each view's edges are
+   written between beginView and endView, which group them under one stroke
+   colour if groupStrokes is set.
+*/
+void writeDocumentPrologue(FILE *f){
+	if (outputFormat == OUTPUT_CANVAS){
+		writeCanvasPrologue(f);
+	} else {
+		writePrologue(f);
+		// togglePart(p) shows or hides part p in every view
+		if (splitParts)
+			fputs("<script>function togglePart(p){document.querySelectorAll('.part'+p).forEach("
+			      "function(g){g.style.display=g.style.display?'':'none';});}</script>\n", f);
+	} /*if*/
+} /* writeDocumentPrologue */
+
+void writeDocumentEpilogue(FILE *f){
+	if (outputFormat == OUTPUT_CANVAS)
+		writeCanvasEpilogue(f);
+	else
+		writeEpilogue(f);
+} /* writeDocumentEpilogue */
+
+void beginView(FILE *f, char colour[]){
+	if (outputFormat == OUTPUT_CANVAS)
+		beginCanvasView(f, colour);
+	else if (groupStrokes)
+		fprintf(f, "<g stroke=\"%s\">\n", colour);
+} /* beginView */
+
+void endView(FILE *f){
+	if (outputFormat == OUTPUT_CANVAS)
+		endCanvasView(f);
+	else if (groupStrokes)
+		fputs("</g>\n", f);
+} /* endView */
+
+#define FNV_OFFSET_BASIS (14695981039346656037ULL)
+#define FNV_PRIME        (1099511628211ULL)
+
+/* hashBytes
+   Folds len bytes starting at data into the running 64-bit FNV-1a hash h and
+   returns the updated hash. A new hash starts from FNV_OFFSET_BASIS.
+*/
+uint64_t hashBytes(uint64_t h, const void *data, size_t len){
+	const unsigned char *p = data;
+	size_t i;
+	for(i=0; i<len; i++){
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+} /* hashBytes */
+
+/* emptyBounds
+   Sets bounds to the empty box, ready to be extended.
+*/
+void emptyBounds(Bounds *bounds){
+	int i;
+	for (i=0; i<3; i++) {
+		bounds->min[i] = FLT_MAX;
+		bounds->max[i] = -FLT_MAX;
+	} /*for*/
+} /* emptyBounds */
+
+/* extendBounds
+   Grows bounds to include both end points of edge.
+*/
+static inline void extendBounds(Bounds *bounds, Matrix edge){
+	int i;
+	for (i=0; i<3; i++) {
+		float lo = edge[i][0] < edge[i][1] ? edge[i][0] : edge[i][1];
+		float hi = edge[i][0] < edge[i][1] ? edge[i][1] : edge[i][0];
+		if (lo < bounds->min[i]) bounds->min[i] = lo;
+		if (hi > bounds->max[i]) bounds->max[i] = hi;
+	} /*for*/
+} /* extendBounds */
+
+/* matMul
+   Computes the matrix product A*B, which is stored in the matrix C.
+   ARows and ACols contain the number of rows and columns of the matrix A.
+   BCols contains the number of columns in B (the number of rows in B is the same
+   as the number of columns in A).
+*/
+void matMul(Matrix A, Matrix B, int ARows, int ACols, int BCols, Matrix C){
+	int x,y,z;
+	for(x=0; x<ARows; x++)
+	for(y=0; y<BCols; y++){
+		C[x][y] = 0;
+		for(z=0; z<ACols; z++){
+			C[x][y]+=(A[x][z])*(B[z][y]);
+		}
+	}
+} /* matMul */
+
+/* computeTransformationMatrix
+   This function creates matrices for a number of transforms and combines them
+   into a signle transform matriix which is returned in parameter M.
+
+   The transforms are those of the given view, applied in this order:
+
+   by view->rx about the x axis
+   by view->ry about the y axis
+   by view->rz about the z axis
+
+   The rotations are to apply BEFORE the scaling, translation and projection
+   transformations.
+
+*/
+void computeTransformationMatrix(Matrix M, View *view) {
+	// returns final transformation in M
+	Matrix P;   // projection matrix
+	Matrix S;   // scaling matrix
+	Matrix T;   // translation matrix
+	Matrix X,Y,Z; //rotation matrices
+	Matrix YZ, XYZ; //resulting matrices
+
+	rotationMatrixX(view->rx, X);
+	rotationMatrixY(view->ry, Y);
+	rotationMatrixZ(view->rz, Z);
+	projectionMatrix(P);
+	scalingMatrix(view->scale, view->scale, -view->scale, S);  // note -scale for z because SVG vertical axis goes downward
+	translationMatrix(view->xt, view->yt, view->zt, T);
+
+	Matrix SXYZ, TSXYZ;
+	// compute final transformation matrix M using matrix multiplication M = P * T * S * R_X * R_Y * R_Z
+	matMul(Y, Z, 4, 4, 4, YZ);
+	matMul(X,YZ, 4, 4, 4, XYZ);
+	matMul(S, XYZ, 4, 4, 4, SXYZ);
+	matMul(T, SXYZ, 4, 4, 4, TSXYZ);
+	matMul(P, TSXYZ, 2, 4, 4, M);
+} /*computeTransformationMatrix*/
+
+
+// A projected edge rounded to output precision, as a slot of a QuantizedEdgeSet
+typedef struct {
+	int32_t q[4];    // x1, y1, x2, y2 in tenths, end points in canonical order
+	bool used;
+} QuantizedEdge;
+
+// Open-addressing hash set of the edges drawn so far in one view
+typedef struct {
+	QuantizedEdge *slots;
+	size_t size;     // a power of two
+} QuantizedEdgeSet;
+
+/* toTenths
+   Returns x rounded to a whole number of tenths exactly as %.1f rounds it:
+   x*10 is exact in double, so rint rounds it to nearest, ties to even, the
+   way printf rounds x. x must be finite and less than INT32_MAX/10 in size.
+*/
+int32_t toTenths(float x){
+	return (int32_t)rint(x*10.0);
+} /* toTenths */
+
+// The decimal digits of 0 to 99, two characters each
+static const char digitPairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/* formatTenths
+   Writes x as %.1f would, without the terminating '\0', and returns the end
+   of what was written. The value is rounded once to integer tenths by
+   toTenths and its digits are copied from digitPairs; only values too large for an int32 of
+   tenths, or not finite, go through printf.
+*/
+char *formatTenths(char *out, float x){
+	if (!(fabs(x*10.0) < INT32_MAX)) return out + sprintf(out, "%.1f", x);
+	int32_t rounded = toTenths(x);
+	uint32_t magnitude = rounded < 0 ? -(uint32_t)rounded : (uint32_t)rounded;
+	if (signbit(x)) *out++ = '-';  // printf keeps the sign of values that round to zero
+	char digits[12];
+	char *first = digits + sizeof(digits);
+	uint32_t whole = magnitude/10;
+	while (whole >= 100) {
+		first -= 2;
+		memcpy(first, &digitPairs[2*(whole % 100)], 2);
+		whole /= 100;
+	} /*while*/
+	if (whole >= 10){
+		first -= 2;
+		memcpy(first, &digitPairs[2*whole], 2);
+	} else
+		*--first = '0' + whole;
+	size_t length = digits + sizeof(digits) - first;
+	memcpy(out, first, length);
+	out += length;
+	*out++ = '.';
+	*out++ = '0' + magnitude % 10;
+	return out;
+} /* formatTenths */
+
+// Copies the string literal s to p and advances p past it
+#define APPEND_LITERAL(p, s) (memcpy((p), (s), sizeof(s) - 1), (p) += sizeof(s) - 1)
+
+/* formatLine
+   Writes the <line> element for (x1,y1)-(x2,y2) to line, styled as writeEdge
+   styles it or, if colour is NULL, unstyled as writeUnstyledEdge writes it.
+   Returns its length. line must hold EDGE_LINE_MAX characters and colour
+   fewer than a quarter of that.
+*/
+size_t formatLine(char line[], float x1, float y1, float x2, float y2, const char colour[]){
+	char *p = line;
+	APPEND_LITERAL(p, "<line x1=\"");
+	p = formatTenths(p, x1);
+	APPEND_LITERAL(p, "\" y1=\"");
+	p = formatTenths(p, y1);
+	APPEND_LITERAL(p, "\" x2=\"");
+	p = formatTenths(p, x2);
+	if (colour == NULL){
+		APPEND_LITERAL(p, "\" y2=\"");
+		p = formatTenths(p, y2);
+		APPEND_LITERAL(p, "\" />\n");
+		return p - line;
+	} /*if*/
+	if (standaloneSVG)
+		APPEND_LITERAL(p, "\" y2=\"");
+	else
+		APPEND_LITERAL(p, "\", y2=\"");
+	p = formatTenths(p, y2);
+	APPEND_LITERAL(p, "\" style=\"stroke: ");
+	size_t colourLength = strlen(colour);
+	memcpy(p, colour, colourLength);
+	p += colourLength;
+	APPEND_LITERAL(p, ";\" />\n");
+	return p - line;
+} /* formatLine */
+
+/* addQuantizedEdge
+   Rounds the projected edge (x1,y1)-(x2,y2) to tenths exactly as writeEdge's
+   %.1f does and adds it to set. Returns false, without adding it, if the edge
+   has zero length at that precision or the set already holds it (in either
+   direction); such an edge would not change the drawing.
+*/
+bool addQuantizedEdge(QuantizedEdgeSet *set, float x1, float y1, float x2, float y2){
+	int32_t a[2] = {toTenths(x1), toTenths(y1)};
+	int32_t b[2] = {toTenths(x2), toTenths(y2)};
+	if (a[0] == b[0] && a[1] == b[1]) return false;
+
+	QuantizedEdge e;
+	bool swap = (a[0] > b[0]) || (a[0] == b[0] && a[1] > b[1]);
+	e.q[0] = swap ? b[0] : a[0]; e.q[1] = swap ? b[1] : a[1];
+	e.q[2] = swap ? a[0] : b[0]; e.q[3] = swap ? a[1] : b[1];
+	e.used = true;
+
+	size_t slot = hashBytes(FNV_OFFSET_BASIS, e.q, sizeof(e.q)) & (set->size - 1);
+	while (set->slots[slot].used) {
+		if (memcmp(set->slots[slot].q, e.q, sizeof(e.q)) == 0) return false;
+		slot = (slot + 1) & (set->size - 1);
+	} /*while*/
+	set->slots[slot] = e;
+	return true;
+} /* addQuantizedEdge */
+
+/* writeUnstyledEdge
+   Writes an edge like writeEdge, but with no colour of its own, so that it
+   takes its stroke from the element that contains or uses it.
+*/
+void writeUnstyledEdge(FILE *f, float x1, float y1, float x2, float y2){
+	PROFILE_BEGIN(STAGE_EMIT);
+	int written;
+	if (fixedPointOutput){
+		char line[EDGE_LINE_MAX];
+		written = formatLine(line, x1, y1, x2, y2, NULL);
+		fwrite(line, 1, written, f);
+	} else
+		written = fprintf(f, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" />\n", x1, y1, x2, y2);
+	PROFILE_END(STAGE_EMIT);
+	PROFILE_COUNT(COUNTER_BYTES_EMITTED, written);
+} /* writeUnstyledEdge */
+
+// Vertices absorbed into a merged line lie within this many pixels of it (half
+// the output's 0.1 pixel precision)
+#define MERGE_TOLERANCE (0.05f)
+
+// One end of a projected edge, keyed by its position
+typedef struct {
+	int32_t x, y;      // in tenths, as written, or the bits of the exact coordinates
+	float direction;   // that the edge leaves this end in, in radians
+	int end;           // 2*edge + 0 or 1
+	int first, last;   // the ends in the same place are ends[first..last-1]
+} EdgeEnd;
+
+int compareEdgeEnds(const void *a, const void *b){
+	const EdgeEnd *p = a, *q = b;
+	if (p->x != q->x) return p->x < q->x ? -1 : 1;
+	if (p->y != q->y) return p->y < q->y ? -1 : 1;
+	if (p->direction != q->direction) return p->direction < q->direction ? -1 : 1;
+	return p->end - q->end;
+} /* compareEdgeEnds */
+
+// The ends of a view's projected edges, sorted so that the ends in the same place
+// are next to each other in the order of the directions their edges leave in,
+// with links past the ends of edges that are used or hidden
+typedef struct {
+	EdgeEnd *ends;
+	int *position;       // where each end (2*edge + 0 or 1) went in ends
+	int *after, *before; // ends[k+1..after[k]-1] and ends[before[k]+1..k-1] are all dead
+} EndOrder;
+
+// The ends of a view's projected edges, by the exact vertex they are at and by
+// their place at output precision, and which edges have been taken
+typedef struct {
+	EndOrder vertex, place;
+	int noEnds;
+	bool *used;          // whether each edge has been taken
+	const bool *hidden;  // edges left out (may be NULL)
+} EndIndex;
+
+/* freeEndOrder
+   Frees the arrays of order.
+*/
+void freeEndOrder(EndOrder *order){
+	free(order->ends); free(order->position); free(order->after); free(order->before);
+} /* freeEndOrder */
+
+/* sortEndOrder
+   Sorts the noEnds ends of the projected edges into order, by their exact
+   position if exact is set and otherwise by their position at output
+   precision. Returns false if memory runs out, leaving order freed.
+*/
+bool sortEndOrder(EndOrder *order, float projected[][4], int noEnds, bool exact){
+	order->ends = malloc((noEnds + 1)*sizeof(EdgeEnd));
+	order->position = malloc((noEnds + 1)*sizeof(int));
+	order->after = malloc((noEnds + 1)*sizeof(int));
+	order->before = malloc((noEnds + 1)*sizeof(int));
+	if (order->ends == NULL || order->position == NULL || order->after == NULL || order->before == NULL){
+		freeEndOrder(order);
+		return false;
+	} /*if*/
+	int i;
+	for (i=0; i<noEnds; i++) {
+		const float *at = &projected[i/2][2*(i%2)], *to = &projected[i/2][2*((i^1)%2)];
+		EdgeEnd *e = &order->ends[i];
+		if (exact){
+			// only equality matters, so the bits of the coordinates serve as keys
+			memcpy(&e->x, &at[0], sizeof(e->x));
+			memcpy(&e->y, &at[1], sizeof(e->y));
+		} else {
+			e->x = toTenths(at[0]);
+			e->y = toTenths(at[1]);
+		} /*if*/
+		e->direction = atan2f(to[1] - at[1], to[0] - at[0]);
+		e->end = i;
+	} /*for*/
+	qsort(order->ends, noEnds, sizeof(EdgeEnd), compareEdgeEnds);
+	int first = 0;
+	for (i=0; i<noEnds; i++) {
+		EdgeEnd *e = &order->ends[i];
+		if (e->x != order->ends[first].x || e->y != order->ends[first].y) first = i;
+		e->first = first;
+		order->position[e->end] = i;
+		order->after[i] = i + 1;
+		order->before[i] = i - 1;
+	} /*for*/
+	for (i=noEnds-1; i>=0; i--) {
+		bool lastInPlace = i == noEnds - 1 || order->ends[i+1].first != order->ends[i].first;
+		order->ends[i].last = lastInPlace ? i + 1 : order->ends[i+1].last;
+	} /*for*/
+	return true;
+} /* sortEndOrder */
+
+/* freeEndIndex
+   Frees the arrays of index.
+*/
+void freeEndIndex(EndIndex *index){
+	freeEndOrder(&index->vertex);
+	freeEndOrder(&index->place);
+	free(index->used);
+} /* freeEndIndex */
+
+/* indexEdgeEnds
+   Builds index over the ends of the noEdges projected edges, none of them
+   used yet, leaving out those marked in hidden (which may be NULL). Returns
+   false if memory runs out.
+*/
+bool indexEdgeEnds(EndIndex *index, float projected[][4], int noEdges, const bool hidden[]){
+	index->noEnds = 2*noEdges;
+	index->hidden = hidden;
+	index->used = calloc(noEdges + 1, sizeof(bool));
+	if (index->used == NULL) return false;
+	if (!sortEndOrder(&index->vertex, projected, index->noEnds, true)){
+		free(index->used);
+		return false;
+	} /*if*/
+	if (!sortEndOrder(&index->place, projected, index->noEnds, false)){
+		freeEndOrder(&index->vertex);
+		free(index->used);
+		return false;
+	} /*if*/
+	return true;
+} /* indexEdgeEnds */
+
+/* deadEnd
+   Returns whether the edge of order's end k is used or hidden in index.
+*/
+bool deadEnd(const EndIndex *index, const EndOrder *order, int k){
+	int edge = order->ends[k].end/2;
+	return index->used[edge] || (index->hidden != NULL && index->hidden[edge]);
+} /* deadEnd */
+
+/* liveAfter
+   Returns the first k' >= k whose end in order is not dead, or noEnds if
+   there is none, and points the links passed over straight at it.
+*/
+int liveAfter(const EndIndex *index, EndOrder *order, int k){
+	int live = k;
+	while (live < index->noEnds && deadEnd(index, order, live)) live = order->after[live];
+	while (k < live) {
+		int next = order->after[k];
+		order->after[k] = live;
+		k = next;
+	} /*while*/
+	return live;
+} /* liveAfter */
+
+/* liveBefore
+   Returns the last k' <= k whose end in order is not dead, or -1 if there is
+   none, and points the links passed over straight at it.
+*/
+int liveBefore(const EndIndex *index, EndOrder *order, int k){
+	int live = k;
+	while (live >= 0 && deadEnd(index, order, live)) live = order->before[live];
+	while (k > live) {
+		int next = order->before[k];
+		order->before[k] = live;
+		k = next;
+	} /*while*/
+	return live;
+} /* liveBefore */
+
+/* nearestEnds
+   Adds to candidates the ends, in the same place of order as end tip, of the
+   edges that are neither used nor hidden and leave nearest to straight on
+   from tip's own edge on either side, the one that turns less first, and
+   returns how many it added (0, 1 or 2). The edge that turns least of all
+   in the place is always the first. It takes time logarithmic in the number
+   of edges that meet there.
+*/
+int nearestEnds(const EndIndex *index, EndOrder *order, float projected[][4], int tip, int candidates[]){
+	const float *at = &projected[tip/2][2*(tip%2)], *back = &projected[tip/2][2*((tip^1)%2)];
+	float inX = at[0] - back[0], inY = at[1] - back[1];
+	float ahead = atan2f(inY, inX);
+	const EdgeEnd *place = &order->ends[order->position[tip]];
+	int first = place->first, last = place->last;
+
+	// the first end that leaves at or anticlockwise of straight on, then its neighbours
+	int low = first, high = last;
+	while (low < high) {
+		int middle = (low + high)/2;
+		if (order->ends[middle].direction < ahead) low = middle + 1;
+		else high = middle;
+	} /*while*/
+	int right = liveAfter(index, order, low);
+	if (right >= last) right = liveAfter(index, order, first);
+	if (right >= last) return 0;
+	int left = liveBefore(index, order, low - 1);
+	if (left < first) left = liveBefore(index, order, last - 1);
+	candidates[0] = order->ends[right].end;
+	if (left == right) return 1;
+	candidates[1] = order->ends[left].end;
+
+	float inLength = sqrtf(inX*inX + inY*inY), turn[2];
+	int i;
+	for (i=0; i<2; i++) {
+		const float *to = &projected[candidates[i]/2][2*((candidates[i]^1)%2)];
+		float outX = to[0] - at[0], outY = to[1] - at[1];
+		float lengths = inLength*sqrtf(outX*outX + outY*outY);
+		turn[i] = lengths > 0 ? (inX*outX + inY*outY)/lengths : 0;  // cosine of the angle between them
+	} /*for*/
+	if (turn[1] > turn[0]){
+		int t = candidates[0];
+		candidates[0] = candidates[1];
+		candidates[1] = t;
+	} /*if*/
+	return 2;
+} /* nearestEnds */
+
+/* straightestEnds
+   Sets candidates to the ends of the unused edges a chain arriving at end tip
+   may go on along, best first, and returns how many there are (up to 4):
+   those nearest to straight on at tip's exact vertex, then those nearest to
+   straight on anywhere in its place at output precision. Preferring the
+   vertex keeps chains of edges shorter than the output's precision in order.
+*/
+int straightestEnds(EndIndex *index, float projected[][4], int tip, int candidates[4]){
+	int noCandidates = nearestEnds(index, &index->vertex, projected, tip, candidates);
+	return noCandidates + nearestEnds(index, &index->place, projected, tip, &candidates[noCandidates]);
+} /* straightestEnds */
+
+
+// The directions from the fixed end of a chain in which its far end may lie
+// for the joined line to pass within MERGE_TOLERANCE of every vertex the chain
+// passes through, strictly between its ends
+typedef struct {
+	float origin[2];   // the fixed end
+	float reference;   // the direction lo and hi are measured from, in radians
+	float lo, hi;      // the directions allowed, in radians from reference
+	float reach2;      // square of the distance to the farthest vertex passed
+} MergeCone;
+
+/* mergeDirection
+   Returns the direction from cone's origin to p, in radians from its
+   reference direction, between -pi and pi.
+*/
+float mergeDirection(const MergeCone *cone, const float p[2]){
+	float angle = atan2f(p[1] - cone->origin[1], p[0] - cone->origin[0]) - cone->reference;
+	if (angle > M_PI) angle -= 2*M_PI;
+	if (angle < -M_PI) angle += 2*M_PI;
+	return angle;
+} /* mergeDirection */
+
+/* startMergeCone
+   Sets cone to allow every direction from origin, measuring them from the
+   direction towards the given point.
+*/
+void startMergeCone(MergeCone *cone, const float origin[2], const float towards[2]){
+	cone->origin[0] = origin[0];
+	cone->origin[1] = origin[1];
+	cone->reference = atan2f(towards[1] - origin[1], towards[0] - origin[0]);
+	cone->lo = -M_PI;
+	cone->hi = M_PI;
+	cone->reach2 = 0;
+} /* startMergeCone */
+
+/* narrowMergeCone
+   Narrows cone to the directions whose lines from its origin pass within
+   MERGE_TOLERANCE of p, and on the same side of the origin as p. Returns
+   false if no direction is left.
+*/
+bool narrowMergeCone(MergeCone *cone, const float p[2]){
+	float dx = p[0] - cone->origin[0], dy = p[1] - cone->origin[1];
+	float r2 = dx*dx + dy*dy;
+	if (!(r2 > 0)) return false;
+	float r = sqrtf(r2);
+	float width = r > MERGE_TOLERANCE ? asinf(MERGE_TOLERANCE/r) : M_PI/2;
+	float centre = mergeDirection(cone, p);
+	if (centre - width > cone->lo) cone->lo = centre - width;
+	if (centre + width < cone->hi) cone->hi = centre + width;
+	if (r2 > cone->reach2) cone->reach2 = r2;
+	return cone->lo <= cone->hi;
+} /* narrowMergeCone */
+
+/* inMergeCone
+   Returns whether the line from cone's origin to c runs in one of its
+   directions and past every vertex it was narrowed by.
+*/
+bool inMergeCone(const MergeCone *cone, const float c[2]){
+	float dx = c[0] - cone->origin[0], dy = c[1] - cone->origin[1];
+	if (!(dx*dx + dy*dy > cone->reach2)) return false;
+	float angle = mergeDirection(cone, c);
+	return angle >= cone->lo && angle <= cone->hi;
+} /* inMergeCone */
+
+/* mergeCollinearEdges
+   Writes to merged the noEdges projected edges, less those marked in hidden
+   (which may be NULL), with chains of edges that meet end to end at output
+   precision and run on in a straight line joined into single edges. A chain
+   grows from each edge in turn, forwards and then backwards, taking at each
+   end whichever of the unused edges either side of straight on (found by
+   straightestEnds) turns less and still keeps every vertex the chain passes
+   through within MERGE_TOLERANCE of the joined line. While a chain grows at one end, the directions its line may take
+   from the other end are narrowed vertex by vertex, so each step costs the
+   same however long the chain. The joined lines run between original end points. Returns
+   the number of edges written, or -1 if memory runs out.
+*/
+int mergeCollinearEdges(float projected[][4], int noEdges, const bool hidden[], float merged[][4]){
+	EndIndex index;
+	int capacity = 64;
+	float *passed = malloc(2*capacity*sizeof(float));  // the vertices inside the current chain
+	if (passed == NULL) return -1;
+	if (!indexEdgeEnds(&index, projected, noEdges, hidden)){
+		free(passed);
+		return -1;
+	} /*if*/
+
+	int edge, noMerged = 0;
+
+	for (edge=0; edge<noEdges; edge++) {
+		if (index.used[edge] || (hidden != NULL && hidden[edge])) continue;
+		index.used[edge] = true;
+		int tip[2] = {2*edge, 2*edge + 1};  // the ends of the chain, as edge ends
+		int noPassed = 0, direction, i;
+		for (direction=1; direction>=0; direction--) {
+			// the line pivots on the other end; refold the vertices already passed
+			const float *from = &projected[tip[1-direction]/2][2*(tip[1-direction]%2)];
+			MergeCone cone;
+			startMergeCone(&cone, from, &projected[tip[direction]/2][2*(tip[direction]%2)]);
+			bool grown = true;
+			for (i=0; i<noPassed && grown; i++) grown = narrowMergeCone(&cone, &passed[2*i]);
+			while (grown) {
+				grown = false;
+				const float *at = &projected[tip[direction]/2][2*(tip[direction]%2)];
+				MergeCone through = cone;
+				if (!narrowMergeCone(&through, at)) break;
+				if (noPassed == capacity){
+					capacity *= 2;
+					float *grownPassed = realloc(passed, 2*capacity*sizeof(float));
+					if (grownPassed == NULL) break;
+					passed = grownPassed;
+				} /*if*/
+				int candidates[4], noCandidates = straightestEnds(&index, projected, tip[direction], candidates);
+				int next = -1, k;
+				for (k=0; k<noCandidates && next<0; k++)
+					if (inMergeCone(&through, &projected[candidates[k]/2][2*((candidates[k]^1)%2)]))
+						next = candidates[k];
+				if (next < 0) break;
+				passed[2*noPassed] = at[0];
+				passed[2*noPassed + 1] = at[1];
+				noPassed++;
+				cone = through;
+				index.used[next/2] = true;
+				tip[direction] = next ^ 1;
+				grown = true;
+			} /*while*/
+		} /*for*/
+		const float *a = &projected[tip[0]/2][2*(tip[0]%2)], *b = &projected[tip[1]/2][2*(tip[1]%2)];
+		merged[noMerged][0] = a[0]; merged[noMerged][1] = a[1];
+		merged[noMerged][2] = b[0]; merged[noMerged][3] = b[1];
+		noMerged++;
+	} /*for*/
+
+	freeEndIndex(&index);
+	free(passed);
+	return noMerged;
+} /* mergeCollinearEdges */
+
+// A chain of edges is simplified so long as it stays within this many pixels of
+// every vertex dropped: SIMPLIFY_TOLERANCE/scale in model units, so the smaller
+// the view, the more it drops
+#define SIMPLIFY_TOLERANCE (0.25f)
+
+/* segmentDistance2
+   Returns the square of the distance from p to the segment from a to b.
+*/
+float segmentDistance2(const float p[2], const float a[2], const float b[2]){
+	float dx = b[0] - a[0], dy = b[1] - a[1];
+	float length2 = dx*dx + dy*dy;
+	float t = length2 > 0 ? ((p[0] - a[0])*dx + (p[1] - a[1])*dy)/length2 : 0;
+	if (t < 0) t = 0;
+	if (t > 1) t = 1;
+	float ex = a[0] + t*dx - p[0], ey = a[1] + t*dy - p[1];
+	return ex*ex + ey*ey;
+} /* segmentDistance2 */
+
+/* simplifyPolyline
+   Sets keep[i] for the points of the polyline points[0..noPoints-1] that
+   Douglas-Peucker keeps: the ends, and then, within each stretch between
+   kept points, the point farthest from the segment joining them if it is
+   more than SIMPLIFY_TOLERANCE away. stack needs room for 2*noPoints ints.
+*/
+void simplifyPolyline(const float *points[], int noPoints, bool keep[], int stack[]){
+	memset(keep, 0, noPoints*sizeof(bool));
+	keep[0] = keep[noPoints-1] = true;
+	int top = 0;
+	stack[top++] = 0;
+	stack[top++] = noPoints - 1;
+	while (top > 0) {
+		int last = stack[--top], first = stack[--top], farthest = -1, i;
+		float worst = SIMPLIFY_TOLERANCE*SIMPLIFY_TOLERANCE;
+		for (i=first+1; i<last; i++) {
+			float d = segmentDistance2(points[i], points[first], points[last]);
+			if (d > worst){
+				worst = d;
+				farthest = i;
+			} /*if*/
+		} /*for*/
+		if (farthest < 0) continue;
+		keep[farthest] = true;
+		stack[top++] = first; stack[top++] = farthest;
+		stack[top++] = farthest; stack[top++] = last;
+	} /*while*/
+} /* simplifyPolyline */
+
+/* followChain
+   Follows a chain of edges on from end tip, adding the far end of each edge
+   taken to points and marking it used in index. At each place it comes to,
+   the chain goes on along the best edge straightestEnds offers: the unused
+   edge that turns least at the exact vertex, or failing that anywhere in the
+   place. It stops when there is none. Returns the number of points added.
+*/
+int followChain(EndIndex *index, float projected[][4], int tip, const float *points[]){
+	int noPoints = 0, candidates[4];
+	while (straightestEnds(index, projected, tip, candidates) > 0) {
+		int next = candidates[0];
+		index->used[next/2] = true;
+		tip = next ^ 1;
+		points[noPoints++] = &projected[tip/2][2*(tip%2)];
+	} /*while*/
+	return noPoints;
+} /* followChain */
+
+/* simplifyEdgeChains
+   Writes to merged the noEdges projected edges, less those marked in hidden
+   (which may be NULL), as chains of edges, each grown both ways from an
+   unused edge by followChain and replaced by its simplification by
+   simplifyPolyline. The ends of each chain are kept, and kept points are
+   original end points; a vertex dropped from a chain, even where other
+   chains meet it, stays within SIMPLIFY_TOLERANCE of the simplified line.
+   Returns the number of edges written, or -1 if memory runs out.
+*/
+int simplifyEdgeChains(float projected[][4], int noEdges, const bool hidden[], float merged[][4]){
+	EndIndex index;
+	bool *keep = malloc((noEdges + 2)*sizeof(bool));
+	int *stack = malloc(2*((size_t)noEdges + 2)*sizeof(int));
+	const float **chain = malloc((noEdges + 2)*sizeof(float *));
+	const float **backward = malloc((noEdges + 1)*sizeof(float *));
+	if (keep == NULL || stack == NULL || chain == NULL || backward == NULL ||
+	    !indexEdgeEnds(&index, projected, noEdges, hidden)){
+		free(keep); free(stack); free(chain); free(backward);
+		return -1;
+	} /*if*/
+
+	int edge, noMerged = 0, i;
+	for (edge=0; edge<noEdges; edge++) {
+		if (index.used[edge] || (hidden != NULL && hidden[edge])) continue;
+		index.used[edge] = true;
+		// the chain is the backward points reversed, then the edge, then the forward points
+		int noBackward = followChain(&index, projected, 2*edge, backward);
+		int noPoints = 0;
+		for (i=noBackward-1; i>=0; i--) chain[noPoints++] = backward[i];
+		chain[noPoints++] = &projected[edge][0];
+		chain[noPoints++] = &projected[edge][2];
+		noPoints += followChain(&index, projected, 2*edge + 1, &chain[noPoints]);
+
+		simplifyPolyline(chain, noPoints, keep, stack);
+		const float *from = chain[0];
+		for (i=1; i<noPoints; i++) {
+			if (!keep[i]) continue;
+			merged[noMerged][0] = from[0]; merged[noMerged][1] = from[1];
+			merged[noMerged][2] = chain[i][0]; merged[noMerged][3] = chain[i][1];
+			noMerged++;
+			from = chain[i];
+		} /*for*/
+	} /*for*/
+
+	freeEndIndex(&index);
+	free(keep); free(stack); free(chain); free(backward);
+	return noMerged;
+} /* simplifyEdgeChains */
+
+// A pass over a view's projected edges that writes fewer edges drawing the same
+// picture, like mergeCollinearEdges
+typedef int (*EdgePass)(float projected[][4], int noEdges, const bool hidden[], float out[][4]);
+
+/* applyEdgePass
+   Runs pass over the *noEdges edges of *projected, less those marked in
+   *hidden, and if it succeeds points *projected at its output, which
+   replaces *owned (freeing the last), clears *hidden and adds the edges it
+   removed to *removed.
+*/
+void applyEdgePass(EdgePass pass, float (**projected)[4], int *noEdges, const bool **hidden,
+                   float (**owned)[4], int *removed){
+	float (*out)[4] = malloc((*noEdges > 0 ? *noEdges : 1)*sizeof(*out));
+	int noOut = out != NULL ? pass(*projected, *noEdges, *hidden, out) : -1;
+	if (noOut < 0){
+		free(out);
+		return;
+	} /*if*/
+	*removed += *noEdges - noOut;
+	free(*owned);
+	*owned = *projected = out;
+	*noEdges = noOut;
+	*hidden = NULL;  // already left out
+} /* applyEdgePass */
+
+/* drawProjected
+   Writes each of the noEdges projected edges (x1, y1, x2, y2) in colour col
+   (or unstyled if col is NULL or the view's group sets the colour), except
+   for the edges marked in hidden (which may be NULL). If mergeCollinear is
+   set, chains of collinear edges are first joined by mergeCollinearEdges,
+   and if simplifyChains is set, chains of edges are simplified by
+   simplifyEdgeChains.
+*/
+void drawProjected(FILE *outFile, float projected[][4], int noEdges, char col[], const bool hidden[]){
+	int culled = 0, noProjected = noEdges;
+	float (*merged)[4] = NULL;
+	if (mergeCollinear && noEdges > 1)
+		applyEdgePass(mergeCollinearEdges, &projected, &noEdges, &hidden, &merged, &culled);
+	if (simplifyChains && noEdges > 1)
+		applyEdgePass(simplifyEdgeChains, &projected, &noEdges, &hidden, &merged, &culled);
+	QuantizedEdgeSet drawn = {NULL, 16};
+	if (cullSubpixelEdges){
+		while (drawn.size < 2*(size_t)noEdges) drawn.size *= 2;
+		drawn.slots = calloc(drawn.size, sizeof(QuantizedEdge));
+	} /*if*/
+	int edge;
+	for (edge=0; edge<noEdges; edge++) {
+		float *R = projected[edge];
+		if (hidden != NULL && hidden[edge]){
+			culled++;
+			continue;
+		} /*if*/
+		// skip edges that would not change the drawing
+		if (drawn.slots != NULL && !addQuantizedEdge(&drawn, R[0], R[1], R[2], R[3])){
+			culled++;
+			continue;
+		} /*if*/
+		// generate SVG (or canvas data) for edge
+		if (outputFormat == OUTPUT_CANVAS)
+			writeCanvasEdge(outFile, R[0], R[1], R[2], R[3]);
+		else if (col == NULL || groupStrokes)
+			writeUnstyledEdge(outFile, R[0], R[1], R[2], R[3]);
+		else
+			writeEdge(outFile, R[0], R[1], R[2], R[3], col);
+		if (echoTransformedEdges)
+			printf("%7.2f %7.2f %7.2f %7.2f\n", R[0], R[1], R[2], R[3]);
+	} /*for*/
+	PROFILE_COUNT(COUNTER_EDGES_TRANSFORMED, noProjected);
+	PROFILE_COUNT(COUNTER_EDGES_CULLED, culled);
+	free(drawn.slots);
+	free(merged);
+} /* drawProjected */
+
+/* drawWireframe
+   Transforms each edge of wireFrame by M and writes it in colour col (or
+   unstyled if col is NULL), except for the edges marked in hidden (which may
+   be NULL).
+*/
+void drawWireframe(FILE* outFile, Matrix wireFrame[], int noEdges, Matrix M, char col[], const bool hidden[]){
+	float single[1][4];  // enough for the edge at a time of streamSVGfile
+	float (*projected)[4] = noEdges <= 1 ? single : malloc(noEdges*sizeof(*projected));
+	if (projected == NULL){
+		printf("Error: Out of memory drawing %d edges\n", noEdges);
+		exit(EXIT_FAILURE);
+	} /*if*/
+	Matrix R;
+	int edge;
+	PROFILE_BEGIN(STAGE_STREAM);
+	for (edge=0; edge<noEdges; edge++) {
+		matMul(M, wireFrame[edge], 2, 4, 2, R);
+		projected[edge][0] = R[0][0]; projected[edge][1] = R[1][0];
+		projected[edge][2] = R[0][1]; projected[edge][3] = R[1][1];
+	} /*for*/
+	PROFILE_END(STAGE_STREAM);
+	drawProjected(outFile, projected, noEdges, col, hidden);
+	if (projected != single) free(projected);
+} /* drawWireframe */
+
+/* viewRotation
+   Sets R to the rotation part of the transformation of view, R_X * R_Y * R_Z.
+   After it, x runs across the canvas, z up it, and y away from the viewer.
+*/
+void viewRotation(View *view, Matrix R){
+	Matrix X, Y, Z, YZ;
+	rotationMatrixX(view->rx, X);
+	rotationMatrixY(view->ry, Y);
+	rotationMatrixZ(view->rz, Z);
+	matMul(Y, Z, 4, 4, 4, YZ);
+	matMul(X, YZ, 4, 4, 4, R);
+} /* viewRotation */
+
+// The edges of a wire frame rotated for one view, kept so that further views
+// with the same rotation need only scale and offset them
+typedef struct {
+	const void *source;    // the wire frame or quantized mesh last rotated, NULL if none yet
+	int noEdges;
+	float rx, ry, rz;      // the rotation they were given
+	float (*rotated)[4];   // x and z of both ends of each edge, after rotation
+	float (*projected)[4]; // the screen coordinates of each edge in the current view
+	int capacity;
+} RotationBuffer;
+
+/* holdsRotation
+   Returns whether buffer already holds the noEdges edges of source rotated as
+   in view.
+*/
+bool holdsRotation(RotationBuffer *buffer, const void *source, int noEdges, View *view){
+	return buffer->source == source && buffer->noEdges == noEdges && buffer->rx == view->rx &&
+	       buffer->ry == view->ry && buffer->rz == view->rz;
+} /* holdsRotation */
+
+/* reserveRotationBuffer
+   Makes room in buffer for noEdges edges and records that it holds the edges
+   of source rotated as in view, which the caller then fills in.
+*/
+void reserveRotationBuffer(RotationBuffer *buffer, const void *source, int noEdges, View *view){
+	if (noEdges > buffer->capacity){
+		free(buffer->rotated);
+		free(buffer->projected);
+		buffer->rotated = malloc(noEdges*sizeof(*buffer->rotated));
+		buffer->projected = malloc(noEdges*sizeof(*buffer->projected));
+		if (buffer->rotated == NULL || buffer->projected == NULL){
+			printf("Error: Out of memory rotating %d edges\n", noEdges);
+			exit(EXIT_FAILURE);
+		} /*if*/
+		buffer->capacity = noEdges;
+	} /*if*/
+	buffer->source = source;
+	buffer->noEdges = noEdges;
+	buffer->rx = view->rx;
+	buffer->ry = view->ry;
+	buffer->rz = view->rz;
+} /* reserveRotationBuffer */
+
+/* rotateWireFrame
+   Fills buffer->rotated with the noEdges edges of wireFrame rotated as in
+   view, unless it already holds them.
+*/
+void rotateWireFrame(RotationBuffer *buffer, Matrix wireFrame[], int noEdges, View *view){
+	if (holdsRotation(buffer, wireFrame, noEdges, view)) return;
+	reserveRotationBuffer(buffer, wireFrame, noEdges, view);
+
+	Matrix R;
+	viewRotation(view, R);
+	PROFILE_BEGIN(STAGE_ROTATE);
+	int edge, end;
+	for (edge=0; edge<noEdges; edge++) {
+		for (end=0; end<2; end++) {
+			float x = wireFrame[edge][0][end], y = wireFrame[edge][1][end], z = wireFrame[edge][2][end];
+			buffer->rotated[edge][2*end] = R[0][0]*x + R[0][1]*y + R[0][2]*z;
+			buffer->rotated[edge][2*end + 1] = R[2][0]*x + R[2][1]*y + R[2][2]*z;
+		} /*for*/
+	} /*for*/
+	PROFILE_END(STAGE_ROTATE);
+} /* rotateWireFrame */
+
+/* rotateQuantizedMesh
+   Fills buffer->rotated with the edges of mesh rotated as in view, unless it
+   already holds them. The dequantization is folded into the rotation, so
+   each vertex costs one 3x3 transform of its integer steps, and the edges
+   then gather the rotated x and z of their ends.
+*/
+void rotateQuantizedMesh(RotationBuffer *buffer, QuantizedMesh *mesh, View *view){
+	if (holdsRotation(buffer, mesh, mesh->noEdges, view)) return;
+	reserveRotationBuffer(buffer, mesh, mesh->noEdges, view);
+	float (*rotated)[2] = malloc((mesh->noVertices > 0 ? mesh->noVertices : 1)*sizeof(*rotated));
+	if (rotated == NULL){
+		printf("Error: Out of memory rotating %d vertices\n", mesh->noVertices);
+		exit(EXIT_FAILURE);
+	} /*if*/
+
+	// R*(origin + step*q) = A*q + b, for the x (row 0) and z (row 2) of R
+	Matrix R;
+	viewRotation(view, R);
+	float A[2][3], b[2];
+	int row, axis;
+	for (row=0; row<2; row++) {
+		b[row] = 0;
+		for (axis=0; axis<3; axis++) {
+			A[row][axis] = R[2*row][axis]*mesh->step[axis];
+			b[row] += R[2*row][axis]*mesh->origin[axis];
+		} /*for*/
+	} /*for*/
+
+	PROFILE_BEGIN(STAGE_ROTATE);
+	int vertex, edge;
+	for (vertex=0; vertex<mesh->noVertices; vertex++) {
+		float x = mesh->vertices[vertex][0], y = mesh->vertices[vertex][1], z = mesh->vertices[vertex][2];
+		rotated[vertex][0] = A[0][0]*x + A[0][1]*y + A[0][2]*z + b[0];
+		rotated[vertex][1] = A[1][0]*x + A[1][1]*y + A[1][2]*z + b[1];
+	} /*for*/
+	for (edge=0; edge<mesh->noEdges; edge++) {
+		float *from = rotated[mesh->edges[edge][0]], *to = rotated[mesh->edges[edge][1]];
+		buffer->rotated[edge][0] = from[0];
+		buffer->rotated[edge][1] = from[1];
+		buffer->rotated[edge][2] = to[0];
+		buffer->rotated[edge][3] = to[1];
+	} /*for*/
+	PROFILE_END(STAGE_ROTATE);
+	free(rotated);
+} /* rotateQuantizedMesh */
+
+/* projectRotated
+   Fills buffer->projected from buffer->rotated with the scale and offset of
+   view: x is scaled and moved by xt, z scaled by -scale (the SVG y axis points
+   down) and moved by zt. It is the same arithmetic as the full transformation
+   of computeTransformationMatrix, reduced to one multiply and add per value.
+*/
+void projectRotated(RotationBuffer *buffer, View *view){
+	const float s = view->scale, xt = view->xt, zt = view->zt;
+	float (*in)[4] = buffer->rotated, (*out)[4] = buffer->projected;
+	PROFILE_BEGIN(STAGE_PROJECT);
+	int edge;
+	for (edge=0; edge<buffer->noEdges; edge++) {
+		out[edge][0] = in[edge][0]*s + xt;
+		out[edge][1] = in[edge][1]*-s + zt;
+		out[edge][2] = in[edge][2]*s + xt;
+		out[edge][3] = in[edge][3]*-s + zt;
+	} /*for*/
+	PROFILE_END(STAGE_PROJECT);
+} /* projectRotated */
+
+/* freeRotationBuffer
+   Frees the arrays of buffer.
+*/
+void freeRotationBuffer(RotationBuffer *buffer){
+	free(buffer->rotated);
+	free(buffer->projected);
+	memset(buffer, 0, sizeof(RotationBuffer));
+} /* freeRotationBuffer */
+
+/* autoFitView
+   Replaces the scale and translation of view so that a wire frame with the
+   given bounds fills it the way a unit-sized model fills the original view:
+   the larger side of the rotated and projected bounding box becomes
+   view->scale pixels long, centred on (view->xt, view->zt). Empty or
+   degenerate bounds leave the view unchanged.
+*/
+void autoFitView(View *view, const Bounds *bounds){
+	Matrix R;
+	viewRotation(view, R);
+
+	// project the corners of the rotated box onto the x (across) and z (up) axes
+	float minX = FLT_MAX, maxX = -FLT_MAX, minZ = FLT_MAX, maxZ = -FLT_MAX;
+	int corner;
+	for (corner=0; corner<8; corner++) {
+		float px = (corner & 1) ? bounds->max[0] : bounds->min[0];
+		float py = (corner & 2) ? bounds->max[1] : bounds->min[1];
+		float pz = (corner & 4) ? bounds->max[2] : bounds->min[2];
+		float x = R[0][0]*px + R[0][1]*py + R[0][2]*pz;
+		float z = R[2][0]*px + R[2][1]*py + R[2][2]*pz;
+		if (x < minX) minX = x;
+		if (x > maxX) maxX = x;
+		if (z < minZ) minZ = z;
+		if (z > maxZ) maxZ = z;
+	} /*for*/
+
+	float extent = fmaxf(maxX - minX, maxZ - minZ);
+	if (!(extent > 0)) return;
+	float scale = view->scale/extent;
+	view->xt -= scale*(minX + maxX)/2;
+	view->zt += scale*(minZ + maxZ)/2;  // z is scaled by -scale
+	view->scale = scale;
+} /* autoFitView */
+
+/* selectDetailLevel
+   Returns the coarsest level of lod that can be drawn at the given scale
+   without moving any vertex by more than LOD_PIXEL_THRESHOLD pixels, or NULL
+   if only the full wire frame is fine enough.
+*/
+DetailLevel *selectDetailLevel(DetailHierarchy *lod, float scale){
+	int level;
+	for (level=lod->noLevels-1; level>=0; level--) {
+		// a vertex moves to its cluster mean, at most a cell diagonal away
+		if (lod->levels[level].cellSize*sqrtf(3)*fabsf(scale) <= LOD_PIXEL_THRESHOLD)
+			return &lod->levels[level];
+	} /*for*/
+	return NULL;
+} /* selectDetailLevel */
+
+/* markHiddenEdges
+   Sets hidden[e] for each of the noEdges edges that lies between two faces
+   which both face away from the viewer in view, and clears it for the rest
+   (front and silhouette edges, and edges without two faces, which include
+   every edge of an open patch). Returns false if memory runs out, in which
+   case hidden is left unset.
+*/
+bool markHiddenEdges(FaceAdjacency *faces, int noEdges, View *view, bool hidden[]){
+	bool *back = malloc((faces->noFaces > 0 ? faces->noFaces : 1)*sizeof(bool));
+	if (back == NULL) return false;
+
+	Matrix R;
+	viewRotation(view, R);
+	int face, edge;
+	for (face=0; face<faces->noFaces; face++) {
+		float *n = faces->normals[face];
+		back[face] = R[1][0]*n[0] + R[1][1]*n[1] + R[1][2]*n[2] > 0;  // pointing away along y
+	} /*for*/
+	for (edge=0; edge<noEdges; edge++) {
+		int f0 = faces->edgeFaces[edge][0], f1 = faces->edgeFaces[edge][1];
+		hidden[edge] = f0 >= 0 && f1 >= 0 && back[f0] && back[f1];
+	} /*for*/
+	free(back);
+	return true;
+} /* markHiddenEdges */
+
+/* drawView
+   Draws the model in view. The view is drawn from the coarsest level of
+   detail of the model that is fine enough for its scale, if it has any;
+   otherwise, if the model's faces are known, the edges hidden behind them
+   are skipped, using hidden (room for a flag per edge, or NULL) as scratch.
+   The edges are rotated through buffer, so that a view with the same
+   rotation as the one before only has to scale and offset them. A model
+   whose vertices have been quantized is rotated from its quantized mesh. A
+   model split into parts is drawn in SVG as a group per part, of class
+   partN, so that a page can show and hide the parts.
+*/
+void drawView(FILE *outFile, Model *model, View *view, bool hidden[], RotationBuffer *buffer) {
+	DetailLevel *level = selectDetailLevel(&model->lod, view->scale);
+	if (level != NULL){
+		PROFILE_COUNT(COUNTER_EDGES_CULLED, model->noEdges - level->noEdges);
+		rotateWireFrame(buffer, level->wireFrame, level->noEdges, view);
+		projectRotated(buffer, view);
+		drawProjected(outFile, buffer->projected, level->noEdges, view->colour, NULL);
+	} else {
+		bool culling = hidden != NULL && markHiddenEdges(&model->faces, model->noEdges, view, hidden);
+		if (model->wireFrame == NULL)
+			rotateQuantizedMesh(buffer, &model->quantized, view);
+		else
+			rotateWireFrame(buffer, model->wireFrame, model->noEdges, view);
+		projectRotated(buffer, view);
+		if (model->noParts > 0 && outputFormat == OUTPUT_SVG){
+			int part;
+			for (part=0; part<model->noParts; part++) {
+				int start = model->partStart[part], count = model->partStart[part+1] - start;
+				fprintf(outFile, "<g class=\"part%d\">\n", part);
+				drawProjected(outFile, buffer->projected + start, count, view->colour,
+				              culling ? hidden + start : NULL);
+				fputs("</g>\n", outFile);
+			} /*for*/
+		} else
+			drawProjected(outFile, buffer->projected, model->noEdges, view->colour, culling ? hidden : NULL);
+	} /*if*/
+} /*drawView*/
+
+/* sameRotation
+   Returns whether views a and b rotate the model identically, so that their
+   drawings differ only by a 2D scale and offset.
+*/
+bool sameRotation(View *a, View *b){
+	return a->rx == b->rx && a->ry == b->ry && a->rz == b->rz;
+} /* sameRotation */
+
+/* drawSharedViews
+   Draws the noViews views in viewList as SVG, writing the geometry of each
+   set of views with the same rotation only once. It is projected, without
+   offset, at the largest scale in the set and put in <defs>; each view then
+   places it with a <use> element carrying its own scale, offset and colour
+   (and a stroke width that undoes the scale).
+*/
+void drawSharedViews(FILE *outFile, Model *model, View viewList[], int noViews, bool hidden[],
+                     RotationBuffer *buffer) {
+	bool *placed = calloc(noViews > 0 ? noViews : 1, sizeof(bool));
+	if (placed == NULL){
+		printf("Error: Out of memory drawing %d views\n", noViews);
+		exit(EXIT_FAILURE);
+	} /*if*/
+	int first, view;
+	for (first=0; first<noViews; first++) {
+		if (placed[first]) continue;
+		View shared = viewList[first];
+		for (view=first; view<noViews; view++)
+			if (sameRotation(&viewList[view], &shared) && fabsf(viewList[view].scale) > fabsf(shared.scale))
+				shared.scale = viewList[view].scale;
+		shared.xt = shared.yt = shared.zt = 0;
+		shared.colour = NULL;
+
+		fprintf(outFile, "<defs>\n<g id=\"view%d\">\n", first);
+		drawView(outFile, model, &shared, hidden, buffer);
+		fputs("</g>\n</defs>\n", outFile);
+
+		for (view=first; view<noViews; view++) {
+			if (placed[view] || !sameRotation(&viewList[view], &shared)) continue;
+			placed[view] = true;
+			float k = viewList[view].scale/shared.scale;
+			fprintf(outFile, "<use href=\"#view%d\" transform=\"matrix(%g 0 0 %g %g %g)\" "
+			        "stroke=\"%s\" stroke-width=\"%g\" />\n", first, k, k, viewList[view].xt,
+			        viewList[view].zt, viewList[view].colour, 1/fabsf(k));
+		} /*for*/
+	} /*for*/
+	free(placed);
+} /* drawSharedViews */
+
+/* drawViews
+   Draws the model once for each of the noViews views in viewList, as
+   drawView does, or through drawSharedViews if shareViewGeometry is set and
+   the output is SVG. Consecutive views with the same rotation share one
+   rotation of the edges.
+*/
+void drawViews(FILE *outFile, Model *model, View viewList[], int noViews) {
+	bool *hidden = NULL;
+	if (model->faces.noFaces > 0) hidden = malloc(model->noEdges*sizeof(bool));
+	RotationBuffer buffer;
+	memset(&buffer, 0, sizeof(RotationBuffer));
+	if (shareViewGeometry && outputFormat == OUTPUT_SVG){
+		drawSharedViews(outFile, model, viewList, noViews, hidden, &buffer);
+	} else {
+		int view;
+		for (view=0; view<noViews; view++) {
+			beginView(outFile, viewList[view].colour);
+			drawView(outFile, model, &viewList[view], hidden, &buffer);
+			endView(outFile);
+		} /*for*/
+	} /*if*/
+	freeRotationBuffer(&buffer);
+	free(hidden);
+} /*drawViews*/
+
+/* generateSVGFile
+   This function opens the file outFileName (normally HTML5_SVG_OUTPUT_FILENAME)
+   for writing
+   and writes the SVG required to display the model on a web page,
+   drawn once for each of the noViews views in viewList.
+*/
+
+void generateSVGfile(const char *outFileName, Model *model, View viewList[], int noViews) {
+
+	FILE *outFile = openOutput(outFileName);
+	writeDocumentPrologue(outFile);
+
+	drawViews(outFile, model, viewList, noViews);
+
+	writeDocumentEpilogue(outFile);
+
+	closeOutput(outFile);
+} /*generateSVGfile*/
+
+/* streamSVGfile
+   Writes the same document as generateSVGfile, for the edges arriving on
+   standard input, to outFileName. The first view is drawn while the edges are
+   parsed and the rest once they have all arrived, so the document starts
+   before the input ends. Only for options that need no whole-model pass.
+*/
+void streamSVGfile(const char *outFileName, View viewList[], int noViews) {
+
+	FILE *outFile = openOutput(outFileName);
+	writeDocumentPrologue(outFile);
+
+	Model model;
+	memset(&model, 0, sizeof(Model));
+	FILE *inFile = openInput(STREAM_FILENAME, "r");
+	beginView(outFile, viewList[0].colour);
+	model.noEdges = parseWireFrame(inFile, STREAM_FILENAME, &model.wireFrame, &model.bounds,
+	                               outFile, &viewList[0]);
+	endView(outFile);
+	closeInput(inFile);
+	drawViews(outFile, &model, viewList + 1, noViews - 1);
+	free(model.wireFrame);
+
+	writeDocumentEpilogue(outFile);
+
+	closeOutput(outFile);
+} /*streamSVGfile*/
+
+/* readViewList
+   Reads a list of views from the file fileName and returns it via viewList,
+   in an array allocated with malloc. The function returns the number of views.
+   Each line of the file describes one view as
+
+     rx ry rz scale xt yt zt colour
+
+   with the rotations given in degrees. A line "canvas width height" sets the
+   size of the canvas instead. Blank lines and lines starting with # are ignored.
+*/
+int readViewList(const char *fileName, View **viewList){
+	FILE *inFile = fopen(fileName, "r");
+	if (inFile == NULL){
+		printf("Error: Unable to open view file %s\n", fileName);
+		exit(EXIT_FAILURE);
+	} /*if*/
+
+	View *list = NULL;
+	int noViews = 0, capacity = 0, lineNo = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), inFile) != NULL) {
+		lineNo++;
+		char *p = line;
+		while (isspace((unsigned char)*p)) p++;
+		if (*p == '\0' || *p == '#') continue;
+
+		int width, height;
+		if (sscanf(p, "canvas %d %d", &width, &height) == 2){
+			canvasWidth = width;
+			canvasHeight = height;
+			continue;
+		} /*if*/
+
+		View v;
+		char colour[64];
+		if (sscanf(p, "%f %f %f %f %f %f %f %63s", &v.rx, &v.ry, &v.rz,
+		           &v.scale, &v.xt, &v.yt, &v.zt, colour) != 8){
+			printf("Error: %s line %d is not a view\n", fileName, lineNo);
+			exit(EXIT_FAILURE);
+		} /*if*/
+		v.rx *= M_PI/180;
+		v.ry *= M_PI/180;
+		v.rz *= M_PI/180;
+		v.colour = strdup(colour);
+
+		if (noViews == capacity){
+			capacity = capacity ? 2*capacity : 16;
+			list = realloc(list, capacity*sizeof(View));
+		} /*if*/
+		if (list == NULL || v.colour == NULL){
+			printf("Error: Out of memory reading view file %s\n", fileName);
+			exit(EXIT_FAILURE);
+		} /*if*/
+		list[noViews++] = v;
+	} /*while*/
+	fclose(inFile);
+
+	*viewList = list;
+	return noViews;
+} /* readViewList */
+
+
+
+/* ========================================================================= */
+/*                               Render Cache                                */
+/* ========================================================================= */
+
+#define RENDER_CACHE_PATH_MAX (256)
+
+/* hashFile
+   Folds the contents of the named file into the hash *h. The file is mapped
+   rather than read so that large models are hashed without copying.
+   Returns false if the file cannot be read.
+*/
+bool hashFile(const char *fileName, uint64_t *h){
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0){
+		close(fd);
+		return false;
+	} /*if*/
+	if (st.st_size > 0){
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED){
+			close(fd);
+			return false;
+		} /*if*/
+		*h = hashBytes(*h, data, st.st_size);
+		munmap(data, st.st_size);
+	} /*if*/
+	close(fd);
+	return true;
+} /* hashFile */
+
+/* temporaryPath
+   Writes to tmp (PATH_MAX characters) the name under which path is written
+   before being renamed into place. Returns false if it does not fit, in which
+   case the caller must not write path at all: a truncated name could be that
+   of another file.
+*/
+bool temporaryPath(char tmp[], const char *path){
+	int length = snprintf(tmp, PATH_MAX, "%s.%ld.tmp", path, (long)getpid());
+	return length >= 0 && length < PATH_MAX;
+} /* temporaryPath */
+
+/* copyFile
+   Copies the file src to dst. The source is mapped into memory and written
+   out with a single write loop, so no user-space buffering is involved.
+   dst is written under a temporary name and renamed into place, so a reader
+   never observes a partial file. Returns false on any failure, including a
+   dst too long for its temporary name.
+*/
+bool copyFile(const char *src, const char *dst){
+	char tmp[PATH_MAX];
+	if (!temporaryPath(tmp, dst)) return false;
+
+	int in = open(src, O_RDONLY);
+	if (in < 0) return false;
+	struct stat st;
+	if (fstat(in, &st) != 0){
+		close(in);
+		return false;
+	} /*if*/
+	int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0){
+		close(in);
+		return false;
+	} /*if*/
+
+	bool ok = true;
+	if (st.st_size > 0){
+		char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+		if (data == MAP_FAILED){
+			ok = false;
+		} else {
+			off_t done = 0;
+			while (done < st.st_size){
+				ssize_t n = write(out, data + done, st.st_size - done);
+				if (n < 0 && errno == EINTR) continue;
+				if (n <= 0){
+					ok = false;
+					break;
+				} /*if*/
+				done += n;
+			} /*while*/
+			munmap(data, st.st_size);
+		} /*if*/
+	} /*if*/
+	close(in);
+	if (close(out) != 0) ok = false;
+
+	if (ok && rename(tmp, dst) != 0) ok = false;
+	if (!ok) unlink(tmp);
+	return ok;
+} /* copyFile */
+
+/* renderCacheKey
+   Computes the key under which a render is cached: a hash of the bytes of the
+   input file and the format they are read in, together with every parameter
+   that affects the output (canvas size, auto-fitting, deduplication, levels
+   of detail, sub-pixel and back-face culling, edge reordering, splitting
+   into parts, vertex quantization, collinear merging, chain simplification,
+   output format, compression, view sharing, stroke grouping and the
+   rotation, scale, translation and colour of each view). Returns false if the input file cannot be read.
+*/
+bool renderCacheKey(const char *inputFileName, View viewList[], int noViews, bool autoFit,
+                    uint64_t *key){
+	uint64_t h = FNV_OFFSET_BASIS;
+	int version = RENDER_CACHE_VERSION;
+	h = hashBytes(h, &version, sizeof(version));
+	h = hashBytes(h, &autoFit, sizeof(autoFit));
+	h = hashBytes(h, &deduplicateEdges, sizeof(deduplicateEdges));
+	h = hashBytes(h, &useDetailLevels, sizeof(useDetailLevels));
+	h = hashBytes(h, &cullSubpixelEdges, sizeof(cullSubpixelEdges));
+	h = hashBytes(h, &cullBackFaces, sizeof(cullBackFaces));
+	h = hashBytes(h, &reorderEdges, sizeof(reorderEdges));
+	h = hashBytes(h, &splitParts, sizeof(splitParts));
+	h = hashBytes(h, &quantizeVertices, sizeof(quantizeVertices));
+	h = hashBytes(h, &mergeCollinear, sizeof(mergeCollinear));
+	h = hashBytes(h, &simplifyChains, sizeof(simplifyChains));
+	h = hashBytes(h, &compressOutput, sizeof(compressOutput));
+	h = hashBytes(h, &outputFormat, sizeof(outputFormat));
+	h = hashBytes(h, &shareViewGeometry, sizeof(shareViewGeometry));
+	h = hashBytes(h, &groupStrokes, sizeof(groupStrokes));
+	MeshFormat format = meshFormat(inputFileName);  // the same bytes may parse differently
+	h = hashBytes(h, &format, sizeof(format));
+	if (!hashFile(inputFileName, &h)) return false;
+
+	int canvas[2] = {canvasWidth, canvasHeight};
+	h = hashBytes(h, canvas, sizeof(canvas));
+
+	int view;
+	for (view=0; view<noViews; view++) {
+		View *v = &viewList[view];
+		float params[7] = {v->rx, v->ry, v->rz, v->scale, v->xt, v->yt, v->zt};
+		h = hashBytes(h, params, sizeof(params));
+		h = hashBytes(h, viewList[view].colour, strlen(viewList[view].colour) + 1);
+	} /*for*/
+
+	*key = h;
+	return true;
+} /* renderCacheKey */
+
+/* renderCachePath
+   Writes the path of the cache entry for key into path.
+*/
+void renderCachePath(uint64_t key, char path[]){
+	snprintf(path, RENDER_CACHE_PATH_MAX, "%s/%016" PRIx64 ".html", RENDER_CACHE_DIR, key);
+} /* renderCachePath */
+
+/* renderCacheCount
+   Records a cache hit or miss in the counters kept in RENDER_CACHE_DIR/stats
+   and reports the running totals on stderr, away from the edge echo.
+*/
+void renderCacheCount(bool hit){
+	char path[RENDER_CACHE_PATH_MAX];
+	long hits = 0, misses = 0;
+	snprintf(path, sizeof(path), "%s/stats", RENDER_CACHE_DIR);
+
+	FILE *f = fopen(path, "r");
+	if (f != NULL){
+		if (fscanf(f, "%ld %ld", &hits, &misses) != 2) hits = misses = 0;
+		fclose(f);
+	} /*if*/
+	if (hit) hits++; else misses++;
+
+	mkdir(RENDER_CACHE_DIR, 0755);
+	f = fopen(path, "w");
+	if (f != NULL){
+		fprintf(f, "%ld %ld\n", hits, misses);
+		fclose(f);
+	} /*if*/
+	fprintf(stderr, "Render cache %s (%ld hits, %ld misses)\n", hit ? "hit" : "miss", hits, misses);
+} /* renderCacheCount */
+
+/* renderCacheFetch
+   If a render for key is cached, copies it to outFileName, marks the entry as
+   most recently used and returns true. Otherwise returns false.
+*/
+bool renderCacheFetch(uint64_t key, const char *outFileName){
+	char path[RENDER_CACHE_PATH_MAX];
+	renderCachePath(key, path);
+
+	if (access(path, R_OK) != 0 || !copyFile(path, outFileName)){
+		renderCacheCount(false);
+		return false;
+	} /*if*/
+	utime(path, NULL);  // the modification time doubles as the LRU timestamp
+	renderCacheCount(true);
+	return true;
+} /* renderCacheFetch */
+
+typedef struct {
+	char name[RENDER_CACHE_PATH_MAX];
+	off_t size;
+	time_t used;
+} RenderCacheEntry;
+
+int compareCacheEntries(const void *a, const void *b){
+	const RenderCacheEntry *x = a, *y = b;
+	return (x->used > y->used) - (x->used < y->used);
+} /* compareCacheEntries */
+
+/* renderCacheEvict
+   Removes the least recently used entries until the cache occupies at most
+   RENDER_CACHE_MAX_BYTES.
+*/
+void renderCacheEvict(){
+	DIR *dir = opendir(RENDER_CACHE_DIR);
+	if (dir == NULL) return;
+
+	RenderCacheEntry *entries = NULL;
+	int noEntries = 0, capacity = 0;
+	off_t total = 0;
+	struct dirent *d;
+	while ((d = readdir(dir)) != NULL) {
+		size_t len = strlen(d->d_name);
+		if (len < 5 || strcmp(d->d_name + len - 5, ".html") != 0) continue;
+
+		if (noEntries == capacity){
+			capacity = capacity ? 2*capacity : 64;
+			RenderCacheEntry *grown = realloc(entries, capacity*sizeof(RenderCacheEntry));
+			if (grown == NULL) break;
+			entries = grown;
+		} /*if*/
+		RenderCacheEntry *e = &entries[noEntries];
+		struct stat st;
+		snprintf(e->name, sizeof(e->name), "%s/%s", RENDER_CACHE_DIR, d->d_name);
+		if (stat(e->name, &st) != 0) continue;
+		e->size = st.st_size;
+		e->used = st.st_mtime;
+		total += e->size;
+		noEntries++;
+	} /*while*/
+	closedir(dir);
+
+	qsort(entries, noEntries, sizeof(RenderCacheEntry), compareCacheEntries);
+	int i;
+	for (i=0; i<noEntries && total>RENDER_CACHE_MAX_BYTES; i++) {
+		if (unlink(entries[i].name) == 0) total -= entries[i].size;
+	} /*for*/
+	free(entries);
+} /* renderCacheEvict */
+
+/* renderCacheStore
+   Adds the freshly rendered file outFileName to the cache under key, then
+   evicts old entries if the cache has grown past its size limit.
+*/
+void renderCacheStore(uint64_t key, const char *outFileName){
+	char path[RENDER_CACHE_PATH_MAX];
+	renderCachePath(key, path);
+
+	if (mkdir(RENDER_CACHE_DIR, 0755) != 0 && errno != EEXIST) return;
+	if (copyFile(outFileName, path)) renderCacheEvict();
+} /* renderCacheStore */
+
+/* ========================================================================= */
+/*                              Geometry Cache                               */
+/* ========================================================================= */
+
+#define GEOMETRY_CACHE_MAGIC   ("WFC1")
+#define GEOMETRY_CACHE_VERSION (1)
+
+// Header of a geometry snapshot. It is followed by POINTS_PER_EDGE floats per edge.
+typedef struct {
+	char magic[4];
+	int32_t version;
+	int64_t sourceSize;      // size of the input file when it was parsed
+	int64_t sourceMtimeSec;  // modification time of the input file when it was parsed
+	int64_t sourceMtimeNsec;
+	uint64_t sourceHash;     // FNV-1a hash of the input file contents
+	int32_t noEdges;
+	int32_t reserved;
+} GeometrySnapshotHeader;
+
+/* geometrySnapshotPath
+   Writes the path of the snapshot belonging to inputFileName into path
+   (PATH_MAX characters). Returns false if it does not fit; a truncated path
+   could be the input file itself, so there is then no snapshot.
+*/
+bool geometrySnapshotPath(const char *inputFileName, char path[]){
+	int length = snprintf(path, PATH_MAX, "%s%s", inputFileName, GEOMETRY_CACHE_SUFFIX);
+	return length >= 0 && length < PATH_MAX;
+} /* geometrySnapshotPath */
+
+/* loadGeometrySnapshot
+   Loads the edges of inputFileName from its snapshot into a newly allocated
+   array returned via wireFrame, and returns the number of edges, or -1 if
+   there is no usable snapshot. The bounding box of the edges is returned
+   through bounds. The snapshot is
+   trusted if the input file has the recorded size and modification time; if
+   only the modification time differs, the contents are hashed and compared.
+*/
+int loadGeometrySnapshot(const char *inputFileName, Matrix **wireFrame, Bounds *bounds){
+	char path[PATH_MAX];
+	if (!geometrySnapshotPath(inputFileName, path)) return -1;
+
+	struct stat source, st;
+	if (stat(inputFileName, &source) != 0) return -1;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(GeometrySnapshotHeader)){
+		close(fd);
+		return -1;
+	} /*if*/
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return -1;
+
+	const GeometrySnapshotHeader *header = map;
+	const float *points = (const float *)(header + 1);
+	bool valid = memcmp(header->magic, GEOMETRY_CACHE_MAGIC, sizeof(header->magic)) == 0 &&
+	             header->version == GEOMETRY_CACHE_VERSION &&
+	             header->noEdges >= 0 &&
+	             st.st_size == (off_t)(sizeof(GeometrySnapshotHeader) +
+	                                   (size_t)header->noEdges*POINTS_PER_EDGE*sizeof(float)) &&
+	             header->sourceSize == source.st_size;
+	if (valid && (header->sourceMtimeSec != source.st_mtim.tv_sec ||
+	              header->sourceMtimeNsec != source.st_mtim.tv_nsec)) {
+		uint64_t h = FNV_OFFSET_BASIS;
+		valid = hashFile(inputFileName, &h) && h == header->sourceHash;
+	} /*if*/
+
+	int noEdges = -1;
+	Matrix *edges = valid ? malloc((header->noEdges > 0 ? header->noEdges : 1)*sizeof(Matrix)) : NULL;
+	if (edges != NULL){
+		int edge;
+		for (edge=0; edge<header->noEdges; edge++) {
+			const float *p = &points[(size_t)edge*POINTS_PER_EDGE];
+			edges[edge][0][0] = p[0]; edges[edge][1][0] = p[1]; edges[edge][2][0] = p[2];
+			edges[edge][0][1] = p[3]; edges[edge][1][1] = p[4]; edges[edge][2][1] = p[5];
+			edges[edge][3][0] = 1;
+			edges[edge][3][1] = 1;
+			extendBounds(bounds, edges[edge]);
+		} /*for*/
+		noEdges = header->noEdges;
+		*wireFrame = edges;
+	} /*if*/
+	munmap(map, st.st_size);
+	return noEdges;
+} /* loadGeometrySnapshot */
+
+/* saveGeometrySnapshot
+   Writes the noEdges edges in wireFrame, parsed from inputFileName, to the
+   snapshot belonging to that file. source is the state of the input file
+   before it was parsed. Failures are ignored; the file is simply parsed again
+   next time.
+*/
+void saveGeometrySnapshot(const char *inputFileName, const struct stat *source,
+                          Matrix wireFrame[], int noEdges){
+	char path[PATH_MAX], tmp[PATH_MAX];
+	if (!geometrySnapshotPath(inputFileName, path) || !temporaryPath(tmp, path)) return;
+
+	GeometrySnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, GEOMETRY_CACHE_MAGIC, sizeof(header.magic));
+	header.version = GEOMETRY_CACHE_VERSION;
+	header.sourceSize = source->st_size;
+	header.sourceMtimeSec = source->st_mtim.tv_sec;
+	header.sourceMtimeNsec = source->st_mtim.tv_nsec;
+	header.sourceHash = FNV_OFFSET_BASIS;
+	header.noEdges = noEdges;
+	if (!hashFile(inputFileName, &header.sourceHash)) return;
+
+	FILE *f = fopen(tmp, "wb");
+	if (f == NULL) return;
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	int edge;
+	for (edge=0; ok && edge<noEdges; edge++) {
+		float p[POINTS_PER_EDGE] = {
+			wireFrame[edge][0][0], wireFrame[edge][1][0], wireFrame[edge][2][0],
+			wireFrame[edge][0][1], wireFrame[edge][1][1], wireFrame[edge][2][1]
+		};
+		ok = fwrite(p, sizeof(p), 1, f) == 1;
+	} /*for*/
+	if (fclose(f) != 0) ok = false;
+
+	if (!ok || rename(tmp, path) != 0) unlink(tmp);
+} /* saveGeometrySnapshot */
+
+/* ========================================================================= */
+/*                            Edge Deduplication                             */
+/* ========================================================================= */
+
+/* edgeKey
+   Writes the end points of edge to key in a canonical order (the
+   lexicographically smaller point first), so that an edge and its reverse
+   have the same key. Negative zeros are folded into positive ones so that
+   equal keys also hash alike.
+*/
+static inline void edgeKey(Matrix edge, float key[POINTS_PER_EDGE]){
+	int first = 0, i;
+	for (i=0; i<3; i++) {
+		if (edge[i][0] != edge[i][1]){
+			first = edge[i][0] < edge[i][1] ? 0 : 1;
+			break;
+		} /*if*/
+	} /*for*/
+	for (i=0; i<3; i++) {
+		key[i] = edge[i][first] + 0.0f;
+		key[i+3] = edge[i][1-first] + 0.0f;
+	} /*for*/
+} /* edgeKey */
+
+/* removeDuplicateEdges
+   Removes every edge of wireFrame that repeats an earlier one, in either
+   direction, keeping the first occurrence and the order of the rest. Edges
+   are looked up by their canonical key in an open-addressing hash table with
+   linear probing. Returns the new number of edges.
+*/
+int removeDuplicateEdges(Matrix wireFrame[], int noEdges){
+	size_t tableSize = 16;
+	while (tableSize < 2*(size_t)noEdges) tableSize *= 2;
+	int *table = calloc(tableSize, sizeof(int));  // index+1 of the edge in each slot, 0 if empty
+	if (table == NULL) return noEdges;
+
+	int kept = 0, edge;
+	for (edge=0; edge<noEdges; edge++) {
+		float key[POINTS_PER_EDGE];
+		edgeKey(wireFrame[edge], key);
+		size_t slot = hashBytes(FNV_OFFSET_BASIS, key, sizeof(key)) & (tableSize - 1);
+
+		bool duplicate = false;
+		while (table[slot] != 0) {
+			float other[POINTS_PER_EDGE];
+			edgeKey(wireFrame[table[slot] - 1], other);
+			if (memcmp(key, other, sizeof(key)) == 0){
+				duplicate = true;
+				break;
+			} /*if*/
+			slot = (slot + 1) & (tableSize - 1);
+		} /*while*/
+		if (duplicate) continue;
+
+		if (kept != edge) memcpy(wireFrame[kept], wireFrame[edge], sizeof(Matrix));
+		table[slot] = ++kept;
+	} /*for*/
+
+	free(table);
+	return kept;
+} /* removeDuplicateEdges */
+
+/* ========================================================================= */
+/*                               Spatial Order                               */
+/*   Edges sorted by the 3D Morton code of their midpoints, so that edges    */
+/*   close together in the model are close together in memory too.          */
+/* ========================================================================= */
+
+// Each axis of the bounds is divided into 2^MORTON_BITS cells
+#define MORTON_BITS  (10)
+// The sort handles the codes 8 bits at a time
+#define RADIX_BITS   (8)
+#define RADIX_PASSES ((3*MORTON_BITS + RADIX_BITS - 1)/RADIX_BITS)
+
+/* spreadBits
+   Returns the low MORTON_BITS bits of v moved to every third bit position.
+*/
+static inline uint32_t spreadBits(uint32_t v){
+	v &= (1u << MORTON_BITS) - 1;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8))  & 0x0300F00F;
+	v = (v | (v << 4))  & 0x030C30C3;
+	v = (v | (v << 2))  & 0x09249249;
+	return v;
+} /* spreadBits */
+
+/* mortonCode
+   Returns the Morton code of the cell of bounds that holds the midpoint of
+   edge: the bits of its x, y and z cell numbers interleaved.
+*/
+uint32_t mortonCode(Matrix edge, const Bounds *bounds){
+	uint32_t code = 0;
+	int axis;
+	for (axis=0; axis<3; axis++) {
+		float extent = bounds->max[axis] - bounds->min[axis];
+		float mid = (edge[axis][0] + edge[axis][1])/2;
+		float cell = extent > 0 ? (mid - bounds->min[axis])/extent*((1 << MORTON_BITS) - 1) : 0;
+		if (!(cell > 0)) cell = 0;  // also catches NaN
+		if (cell > (1 << MORTON_BITS) - 1) cell = (1 << MORTON_BITS) - 1;
+		code |= spreadBits((uint32_t)(cell + 0.5f)) << axis;
+	} /*for*/
+	return code;
+} /* mortonCode */
+
+/* reorderWireFrame
+   Sorts the noEdges edges of wireFrame, whose points all lie in bounds, into
+   the order of the Morton codes of their midpoints. The sort is a least
+   significant digit radix sort, RADIX_BITS at a time, so edges in the same
+   cell keep their order. Vertices numbered in order of first use, as by
+   indexWireFrame, follow the same order. Returns false, leaving wireFrame
+   as it was, if memory runs out.
+*/
+bool reorderWireFrame(Matrix wireFrame[], int noEdges, const Bounds *bounds){
+	size_t n = noEdges > 0 ? noEdges : 1;
+	uint32_t *codes = malloc(n*sizeof(uint32_t));
+	int *order = malloc(n*sizeof(int)), *sorted = malloc(n*sizeof(int));
+	Matrix *copy = malloc(n*sizeof(Matrix));
+	if (codes == NULL || order == NULL || sorted == NULL || copy == NULL){
+		free(codes); free(order); free(sorted); free(copy);
+		return false;
+	} /*if*/
+
+	int edge, pass, digit;
+	for (edge=0; edge<noEdges; edge++) {
+		codes[edge] = mortonCode(wireFrame[edge], bounds);
+		order[edge] = edge;
+	} /*for*/
+	for (pass=0; pass<RADIX_PASSES; pass++) {
+		int shift = pass*RADIX_BITS;
+		int start[(1 << RADIX_BITS) + 1];
+		memset(start, 0, sizeof(start));
+		for (edge=0; edge<noEdges; edge++)
+			start[((codes[order[edge]] >> shift) & ((1 << RADIX_BITS) - 1)) + 1]++;
+		for (digit=0; digit<(1 << RADIX_BITS); digit++)
+			start[digit+1] += start[digit];
+		for (edge=0; edge<noEdges; edge++)
+			sorted[start[(codes[order[edge]] >> shift) & ((1 << RADIX_BITS) - 1)]++] = order[edge];
+		int *swap = order;
+		order = sorted;
+		sorted = swap;
+	} /*for*/
+
+	memcpy(copy, wireFrame, noEdges*sizeof(Matrix));
+	for (edge=0; edge<noEdges; edge++)
+		memcpy(wireFrame[edge], copy[order[edge]], sizeof(Matrix));
+	free(codes); free(order); free(sorted); free(copy);
+	return true;
+} /* reorderWireFrame */
+
+/* ========================================================================= */
+/*                              Level of Detail                              */
+/* ========================================================================= */
+
+// A grid cell and the cluster of vertices that fell into it
+typedef struct {
+	int32_t cell[3];
+	int cluster;     // -1 if the slot is empty
+} ClusterSlot;
+
+/* buildDetailLevel
+   Simplifies wireFrame by clustering its vertices on a grid of the given cell
+   size, anchored at the minimum corner of bounds. Every vertex is replaced by
+   the mean of its cluster, edges whose end points fall into the same cell are
+   dropped, and edges that become identical are merged. The simplified edges
+   are returned in a newly allocated array via levelOut, and their number is
+   returned. Returns -1 if memory runs out.
+*/
+int buildDetailLevel(Matrix wireFrame[], int noEdges, const Bounds *bounds, float cellSize,
+                     Matrix **levelOut){
+	size_t noPoints = 2*(size_t)noEdges;
+	size_t tableSize = 16;
+	while (tableSize < 2*noPoints) tableSize *= 2;
+	ClusterSlot *table = malloc(tableSize*sizeof(ClusterSlot));
+	float (*sums)[4] = malloc((noPoints > 0 ? noPoints : 1)*sizeof(*sums));  // x, y, z, count
+	int *clusterOf = malloc((noPoints > 0 ? noPoints : 1)*sizeof(int));
+	Matrix *level = malloc((noEdges > 0 ? noEdges : 1)*sizeof(Matrix));
+	if (table == NULL || sums == NULL || clusterOf == NULL || level == NULL){
+		free(table); free(sums); free(clusterOf); free(level);
+		return -1;
+	} /*if*/
+
+	size_t i;
+	for (i=0; i<tableSize; i++) table[i].cluster = -1;
+	int noClusters = 0;
+	for (i=0; i<noPoints; i++) {
+		Matrix *edge = &wireFrame[i/2];
+		int end = i % 2, axis;
+		int32_t cell[3];
+		for (axis=0; axis<3; axis++)
+			cell[axis] = (int32_t)floorf(((*edge)[axis][end] - bounds->min[axis])/cellSize);
+
+		size_t slot = hashBytes(FNV_OFFSET_BASIS, cell, sizeof(cell)) & (tableSize - 1);
+		while (table[slot].cluster >= 0 && memcmp(table[slot].cell, cell, sizeof(cell)) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+		if (table[slot].cluster < 0){
+			memcpy(table[slot].cell, cell, sizeof(cell));
+			table[slot].cluster = noClusters;
+			sums[noClusters][0] = sums[noClusters][1] = sums[noClusters][2] = sums[noClusters][3] = 0;
+			noClusters++;
+		} /*if*/
+
+		int cluster = table[slot].cluster;
+		for (axis=0; axis<3; axis++) sums[cluster][axis] += (*edge)[axis][end];
+		sums[cluster][3] += 1;
+		clusterOf[i] = cluster;
+	} /*for*/
+	int cluster;
+	for (cluster=0; cluster<noClusters; cluster++) {
+		sums[cluster][0] /= sums[cluster][3];
+		sums[cluster][1] /= sums[cluster][3];
+		sums[cluster][2] /= sums[cluster][3];
+	} /*for*/
+
+	int noLevelEdges = 0, edge;
+	for (edge=0; edge<noEdges; edge++) {
+		int a = clusterOf[2*edge], b = clusterOf[2*edge + 1], axis;
+		if (a == b) continue;  // collapsed to a point
+		for (axis=0; axis<3; axis++) {
+			level[noLevelEdges][axis][0] = sums[a][axis];
+			level[noLevelEdges][axis][1] = sums[b][axis];
+		} /*for*/
+		level[noLevelEdges][3][0] = 1;
+		level[noLevelEdges][3][1] = 1;
+		noLevelEdges++;
+	} /*for*/
+	noLevelEdges = removeDuplicateEdges(level, noLevelEdges);
+
+	free(table);
+	free(sums);
+	free(clusterOf);
+	Matrix *shrunk = realloc(level, (noLevelEdges > 0 ? noLevelEdges : 1)*sizeof(Matrix));
+	*levelOut = (shrunk != NULL) ? shrunk : level;
+	return noLevelEdges;
+} /* buildDetailLevel */
+
+/* buildDetailHierarchy
+   Builds up to LOD_LEVELS simplified levels of wireFrame into lod, with grid
+   cells LOD_FINEST_RESOLUTION, then half as many, ... across the largest side
+   of bounds. Levels that would not remove any edges are skipped.
+*/
+void buildDetailHierarchy(Matrix wireFrame[], int noEdges, const Bounds *bounds, DetailHierarchy *lod){
+	lod->noLevels = 0;
+	float extent = 0;
+	int axis, level;
+	for (axis=0; axis<3; axis++)
+		extent = fmaxf(extent, bounds->max[axis] - bounds->min[axis]);
+	if (!(extent > 0)) return;
+
+	int resolution = LOD_FINEST_RESOLUTION, previous = noEdges;
+	for (level=0; level<LOD_LEVELS; level++, resolution /= 2) {
+		DetailLevel *l = &lod->levels[lod->noLevels];
+		l->cellSize = extent/resolution;
+		l->noEdges = buildDetailLevel(wireFrame, noEdges, bounds, l->cellSize, &l->wireFrame);
+		if (l->noEdges < 0) return;
+		if (l->noEdges == previous){
+			free(l->wireFrame);
+			continue;
+		} /*if*/
+		previous = l->noEdges;
+		lod->noLevels++;
+	} /*for*/
+} /* buildDetailHierarchy */
+
+/* freeDetailHierarchy
+   Frees the levels of lod.
+*/
+void freeDetailHierarchy(DetailHierarchy *lod){
+	int level;
+	for (level=0; level<lod->noLevels; level++)
+		free(lod->levels[level].wireFrame);
+	lod->noLevels = 0;
+} /* freeDetailHierarchy */
+
+/* ========================================================================= */
+/*                               Indexed Mesh                                */
+/* ========================================================================= */
+
+/* indexWireFrame
+   Builds mesh from wireFrame by giving each distinct end point a vertex
+   number, so that edges meeting at a point share its vertex. Points are
+   matched exactly, through an open-addressing hash table. Edge e of mesh is
+   edge e of wireFrame. Returns false if memory runs out.
+*/
+bool indexWireFrame(Matrix wireFrame[], int noEdges, IndexedMesh *mesh){
+	size_t noPoints = 2*(size_t)noEdges;
+	size_t tableSize = 16;
+	while (tableSize < 2*noPoints) tableSize *= 2;
+	int *table = malloc(tableSize*sizeof(int));  // vertex number in each slot, -1 if empty
+	mesh->vertices = malloc((noPoints > 0 ? noPoints : 1)*sizeof(*mesh->vertices));
+	mesh->edges = malloc((noEdges > 0 ? noEdges : 1)*sizeof(*mesh->edges));
+	mesh->noVertices = 0;
+	mesh->noEdges = noEdges;
+	if (table == NULL || mesh->vertices == NULL || mesh->edges == NULL){
+		free(table); free(mesh->vertices); free(mesh->edges);
+		mesh->vertices = NULL;
+		mesh->edges = NULL;
+		return false;
+	} /*if*/
+
+	size_t i;
+	for (i=0; i<tableSize; i++) table[i] = -1;
+	for (i=0; i<noPoints; i++) {
+		Matrix *edge = &wireFrame[i/2];
+		int end = i % 2;
+		float p[3] = {(*edge)[0][end] + 0.0f, (*edge)[1][end] + 0.0f, (*edge)[2][end] + 0.0f};
+		size_t slot = hashBytes(FNV_OFFSET_BASIS, p, sizeof(p)) & (tableSize - 1);
+		while (table[slot] >= 0 && memcmp(mesh->vertices[table[slot]], p, sizeof(p)) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+		if (table[slot] < 0){
+			table[slot] = mesh->noVertices;
+			memcpy(mesh->vertices[mesh->noVertices++], p, sizeof(p));
+		} /*if*/
+		mesh->edges[i/2][end] = table[slot];
+	} /*for*/
+	free(table);
+
+	float (*shrunk)[3] = realloc(mesh->vertices, (mesh->noVertices > 0 ? mesh->noVertices : 1)*sizeof(*shrunk));
+	if (shrunk != NULL) mesh->vertices = shrunk;
+	return true;
+} /* indexWireFrame */
+
+/* freeIndexedMesh
+   Frees the arrays of mesh.
+*/
+void freeIndexedMesh(IndexedMesh *mesh){
+	free(mesh->vertices);
+	free(mesh->edges);
+	mesh->vertices = NULL;
+	mesh->edges = NULL;
+	mesh->noVertices = mesh->noEdges = 0;
+} /* freeIndexedMesh */
+
+/* ========================================================================= */
+/*                                Edge Graph                                 */
+/* ========================================================================= */
+
+/* freeEdgeGraph
+   Frees the arrays of g.
+*/
+void freeEdgeGraph(EdgeGraph *g){
+	freeIndexedMesh(&g->mesh);
+	free(g->ends); free(g->distinctOf);
+	free(g->first); free(g->neighbour); free(g->edge);
+	memset(g, 0, sizeof(EdgeGraph));
+} /* freeEdgeGraph */
+
+/* buildEdgeGraph
+   Builds the edge graph g of the noEdges edges of wireFrame. Points are
+   matched exactly into vertices by indexWireFrame, repeated edges (in either
+   direction) are numbered once through an open-addressing hash table, and the
+   rows of neighbours are laid out by counting the degree of each vertex and
+   taking the prefix sum, so any traversal of the graph is O(edges). Returns
+   false, leaving g empty, if memory runs out.
+*/
+bool buildEdgeGraph(Matrix wireFrame[], int noEdges, EdgeGraph *g){
+	memset(g, 0, sizeof(EdgeGraph));
+	if (!indexWireFrame(wireFrame, noEdges, &g->mesh)) return false;
+	int noVertices = g->mesh.noVertices;
+
+	size_t tableSize = 16;
+	while (tableSize < 2*(size_t)noEdges) tableSize *= 2;
+	int *table = malloc(tableSize*sizeof(int));  // distinct edge in each slot, -1 if empty
+	int *fill = malloc((noVertices > 0 ? noVertices : 1)*sizeof(int));
+	g->distinctOf = malloc((noEdges > 0 ? noEdges : 1)*sizeof(int));
+	g->ends = malloc((noEdges > 0 ? noEdges : 1)*sizeof(*g->ends));
+	g->first = calloc(noVertices + 1, sizeof(int));
+	g->neighbour = malloc((2*(size_t)noEdges + 1)*sizeof(int));
+	g->edge = malloc((2*(size_t)noEdges + 1)*sizeof(int));
+	if (table == NULL || fill == NULL || g->distinctOf == NULL || g->ends == NULL ||
+	    g->first == NULL || g->neighbour == NULL || g->edge == NULL){
+		free(table); free(fill);
+		freeEdgeGraph(g);
+		return false;
+	} /*if*/
+
+	// number the distinct undirected edges
+	size_t i;
+	int e, v;
+	for (i=0; i<tableSize; i++) table[i] = -1;
+	for (e=0; e<noEdges; e++) {
+		int a = g->mesh.edges[e][0], b = g->mesh.edges[e][1];
+		g->distinctOf[e] = -1;
+		if (a == b) continue;
+		int key[2] = {a < b ? a : b, a < b ? b : a};
+		size_t slot = hashBytes(FNV_OFFSET_BASIS, key, sizeof(key)) & (tableSize - 1);
+		while (table[slot] >= 0 && memcmp(g->ends[table[slot]], key, sizeof(key)) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+		if (table[slot] < 0){
+			table[slot] = g->noDistinct;
+			memcpy(g->ends[g->noDistinct++], key, sizeof(key));
+		} /*if*/
+		g->distinctOf[e] = table[slot];
+	} /*for*/
+	free(table);
+
+	// count the degrees, sum them into row starts, then fill the rows
+	for (e=0; e<g->noDistinct; e++) {
+		g->first[g->ends[e][0] + 1]++;
+		g->first[g->ends[e][1] + 1]++;
+	} /*for*/
+	for (v=0; v<noVertices; v++) g->first[v+1] += g->first[v];
+	memcpy(fill, g->first, noVertices*sizeof(int));
+	for (e=0; e<g->noDistinct; e++) {
+		int a = g->ends[e][0], b = g->ends[e][1];
+		g->neighbour[fill[a]] = b; g->edge[fill[a]++] = e;
+		g->neighbour[fill[b]] = a; g->edge[fill[b]++] = e;
+	} /*for*/
+	free(fill);
+	return true;
+} /* buildEdgeGraph */
+
+/* graphEdge
+   Returns the distinct edge joining vertices a and b, or -1 if there is none.
+*/
+int graphEdge(EdgeGraph *g, int a, int b){
+	int k;
+	for (k=g->first[a]; k<g->first[a+1]; k++)
+		if (g->neighbour[k] == b) return g->edge[k];
+	return -1;
+} /* graphEdge */
+
+/* ========================================================================= */
+/*                              Connected Parts                              */
+/* ========================================================================= */
+
+/* findRoot
+   Returns the root of v in the union-find forest parent, halving the path
+   to it on the way.
+*/
+static inline int findRoot(int parent[], int v){
+	while (parent[v] != v) {
+		parent[v] = parent[parent[v]];
+		v = parent[v];
+	} /*while*/
+	return v;
+} /* findRoot */
+
+/* splitIntoParts
+   Finds the connected parts of the noEdges edges of wireFrame from their edge
+   graph g, by union-find over the distinct edges (union by size, path
+   halving), and numbers them in order of their first edge. The edges of
+   wireFrame, and the per-edge arrays of g with them, are then stably sorted
+   by part, so that the edges of part p are partStart[p] .. partStart[p+1]-1.
+   *partStart is allocated here. Returns the number of parts, or 0, leaving
+   everything as it was, if memory runs out.
+*/
+int splitIntoParts(Matrix wireFrame[], int noEdges, EdgeGraph *g, int **partStart){
+	int noVertices = g->mesh.noVertices;
+	size_t n = noEdges > 0 ? noEdges : 1;
+	int *parent = malloc((noVertices > 0 ? noVertices : 1)*sizeof(int));
+	int *size = malloc((noVertices > 0 ? noVertices : 1)*sizeof(int));
+	int *partOf = malloc((noVertices > 0 ? noVertices : 1)*sizeof(int));
+	int *start = malloc((n + 1)*sizeof(int));
+	int *order = malloc(n*sizeof(int));
+	Matrix *copy = malloc(n*sizeof(Matrix));
+	int (*ends)[2] = malloc(n*sizeof(*ends));
+	int *distinctOf = malloc(n*sizeof(int));
+	if (parent == NULL || size == NULL || partOf == NULL || start == NULL || order == NULL ||
+	    copy == NULL || ends == NULL || distinctOf == NULL){
+		free(parent); free(size); free(partOf); free(start); free(order);
+		free(copy); free(ends); free(distinctOf);
+		return 0;
+	} /*if*/
+
+	int v, e, noParts = 0;
+	for (v=0; v<noVertices; v++) {
+		parent[v] = v;
+		size[v] = 1;
+		partOf[v] = -1;
+	} /*for*/
+	for (e=0; e<g->noDistinct; e++) {
+		int a = findRoot(parent, g->ends[e][0]), b = findRoot(parent, g->ends[e][1]);
+		if (a == b) continue;
+		if (size[a] < size[b]){
+			int t = a; a = b; b = t;
+		} /*if*/
+		parent[b] = a;
+		size[a] += size[b];
+	} /*for*/
+
+	// number the parts in order of their first edge and count their edges
+	memset(start, 0, (n + 1)*sizeof(int));
+	for (e=0; e<noEdges; e++) {
+		int root = findRoot(parent, g->mesh.edges[e][0]);
+		if (partOf[root] < 0) partOf[root] = noParts++;
+		start[partOf[root] + 1]++;
+	} /*for*/
+	int p;
+	for (p=0; p<noParts; p++) start[p+1] += start[p];
+
+	// place each edge after the earlier edges of its part
+	memcpy(order, start, noParts*sizeof(int));
+	memcpy(copy, wireFrame, noEdges*sizeof(Matrix));
+	memcpy(ends, g->mesh.edges, noEdges*sizeof(*ends));
+	memcpy(distinctOf, g->distinctOf, noEdges*sizeof(int));
+	for (e=0; e<noEdges; e++) {
+		int to = order[partOf[findRoot(parent, ends[e][0])]]++;
+		memcpy(wireFrame[to], copy[e], sizeof(Matrix));
+		memcpy(g->mesh.edges[to], ends[e], sizeof(*ends));
+		g->distinctOf[to] = distinctOf[e];
+	} /*for*/
+
+	free(parent); free(size); free(partOf); free(order);
+	free(copy); free(ends); free(distinctOf);
+	*partStart = start;
+	return noParts;
+} /* splitIntoParts */
+
 /* ========================================================================= */
-/*                       Library Function  Declarations                      */
-/*            These functions are defined at the end of the file.            */
+/*                              Quantized Mesh                               */
 /* ========================================================================= */
 
+// Vertices are stored as steps from -QUANTIZE_STEPS to QUANTIZE_STEPS across the bounds
+#define QUANTIZE_STEPS (32767)
 
-/* writePrologue
-   This function writes the initial part of the HTML5 file (which sets up the
-   graphics interface). This must be called before any graphical data is written
-   to the file.
+/* quantizeWireFrame
+   Builds mesh from the noEdges edges of wireFrame, whose points all lie in
+   bounds: the distinct points become vertices, each rounded to the nearest
+   of 2*QUANTIZE_STEPS+1 steps across the bounds along each axis, and edge e
+   of mesh is edge e of wireFrame. A vertex moves by at most half a step.
+   Returns false if memory runs out.
 */
-void writePrologue(FILE *f);
+bool quantizeWireFrame(Matrix wireFrame[], int noEdges, const Bounds *bounds, QuantizedMesh *mesh){
+	IndexedMesh indexed;
+	memset(mesh, 0, sizeof(QuantizedMesh));
+	if (!indexWireFrame(wireFrame, noEdges, &indexed)) return false;
+	mesh->vertices = malloc((indexed.noVertices > 0 ? indexed.noVertices : 1)*sizeof(*mesh->vertices));
+	if (mesh->vertices == NULL){
+		freeIndexedMesh(&indexed);
+		return false;
+	} /*if*/
 
-/* writeEpilogue
-   This function writes the final part of the HTML5 file. This must be called
-   after all data has been written, but before the file is closed.
-   (The caller is responsible for closing the file afterwards).
+	int axis, vertex;
+	for (axis=0; axis<3; axis++) {
+		float extent = noEdges > 0 ? bounds->max[axis] - bounds->min[axis] : 0;
+		mesh->origin[axis] = noEdges > 0 ? bounds->min[axis] + extent/2 : 0;
+		mesh->step[axis] = extent > 0 ? extent/(2*QUANTIZE_STEPS) : 1;
+	} /*for*/
+	for (vertex=0; vertex<indexed.noVertices; vertex++) {
+		for (axis=0; axis<3; axis++) {
+			long q = lrintf((indexed.vertices[vertex][axis] - mesh->origin[axis])/mesh->step[axis]);
+			if (q > QUANTIZE_STEPS) q = QUANTIZE_STEPS;
+			if (q < -QUANTIZE_STEPS) q = -QUANTIZE_STEPS;
+			mesh->vertices[vertex][axis] = (int16_t)q;
+		} /*for*/
+	} /*for*/
+	mesh->noVertices = indexed.noVertices;
+	mesh->edges = indexed.edges;  // taken over from indexed
+	mesh->noEdges = indexed.noEdges;
+	free(indexed.vertices);
+	return true;
+} /* quantizeWireFrame */
+
+/* quantizedMeshBytes
+   Returns the memory held by the arrays of mesh.
 */
-void writeEpilogue(FILE *f);
+size_t quantizedMeshBytes(QuantizedMesh *mesh){
+	return mesh->noVertices*sizeof(*mesh->vertices) + mesh->noEdges*sizeof(*mesh->edges);
+} /* quantizedMeshBytes */
 
-/* writeEdge
-   This function writes an edge into the HTML5 file referenced by f.
-   The edge segment begins at point (x1,y1) and ends at point (x2,y2).
-   The edge is drawn with the specified colour.
+/* freeQuantizedMesh
+   Frees the arrays of mesh.
 */
-void writeEdge(FILE *f, float x1, float y1, float x2, float y2, char colour[]);
+void freeQuantizedMesh(QuantizedMesh *mesh){
+	free(mesh->vertices);
+	free(mesh->edges);
+	memset(mesh, 0, sizeof(QuantizedMesh));
+} /* freeQuantizedMesh */
 
-/* projectionMatrix
-   This function sets the provided matrix to a 2x4 projection matrix, which
-   is used to convert points in 3 dimensions to points in 2 dimensions.
+/* ========================================================================= */
+/*                                Mesh Import                                */
+/*   Streaming readers for OBJ, PLY (ASCII and binary) and STL (ASCII and     */
+/*   binary) files. Each reads through a fixed buffer, never allocating per   */
+/*   line, and produces an IndexedMesh whose edges are the distinct sides of  */
+/*   the file's faces and lines.                                              */
+/* ========================================================================= */
+
+#define IMPORT_LINE_MAX     (4096)
+#define IMPORT_STL_BATCH    (256)  // triangles read from a binary STL file at a time
+#define PLY_MAX_ELEMENTS    (8)
+#define PLY_MAX_PROPERTIES  (16)
+#define PLY_NAME_MAX        (32)
+
+// An IndexedMesh under construction. Edges are kept distinct through edgeTable;
+// vertexTable is only used when vertices are welded by position (STL).
+typedef struct {
+	const char *fileName;  // for error messages
+	IndexedMesh mesh;
+	int vertexCapacity;
+	int edgeCapacity;
+	int *vertexTable;      // vertex number in each slot, -1 if empty
+	size_t vertexTableSize;
+	int *edgeTable;        // edge number in each slot, -1 if empty
+	size_t edgeTableSize;
+} MeshBuilder;
+
+/* meshFormat
+   Returns the format of fileName, judged by its extension (ignoring any
+   COMPRESSED_SUFFIX after it). Anything that is not .obj, .ply or .stl is
+   taken to be the edge list format.
 */
+MeshFormat meshFormat(const char *fileName){
+	char extension[8];
+	size_t length = strlen(fileName);
+	if (hasCompressedSuffix(fileName)) length -= strlen(COMPRESSED_SUFFIX);
+	if (length < 4 || fileName[length-4] != '.') return MESH_FORMAT_EDGES;
+	memcpy(extension, fileName + length - 4, 4);
+	extension[4] = '\0';
+	if (strcasecmp(extension, ".obj") == 0) return MESH_FORMAT_OBJ;
+	if (strcasecmp(extension, ".ply") == 0) return MESH_FORMAT_PLY;
+	if (strcasecmp(extension, ".stl") == 0) return MESH_FORMAT_STL;
+	return MESH_FORMAT_EDGES;
+} /* meshFormat */
 
-void projectionMatrix(Matrix outM);
+/* importError
+   Reports a malformed or unreadable mesh file through loadFailed.
+*/
+void importError(const char *fileName, const char *problem){
+	loadFailed("Unable to import %s: %s", fileName, problem);
+} /* importError */
 
-/* rotationMatrixX
-   Sets the matrix outM to contain a 4x4 rotation matrix for a rotation
-   of the given angle (which is provided in radians) around the X axis.
+/* growTable
+   Replaces *table with an empty table of size slots, all -1.
+*/
+void growTable(MeshBuilder *b, int **table, size_t size){
+	free(*table);
+	*table = malloc(size*sizeof(int));
+	if (*table == NULL) importError(b->fileName, "out of memory");
+	size_t i;
+	for (i=0; i<size; i++) (*table)[i] = -1;
+} /* growTable */
 
+void initMeshBuilder(MeshBuilder *b, const char *fileName){
+	memset(b, 0, sizeof(MeshBuilder));
+	b->fileName = fileName;
+} /* initMeshBuilder */
+
+/* addMeshVertex
+   Appends vertex p to the mesh and returns its number.
 */
-void rotationMatrixX(float angle, Matrix outM);
+int addMeshVertex(MeshBuilder *b, const float p[3]){
+	IndexedMesh *m = &b->mesh;
+	if (m->noVertices == b->vertexCapacity){
+		if (b->vertexCapacity >= INT32_MAX/2) importError(b->fileName, "too many vertices");
+		b->vertexCapacity = b->vertexCapacity ? 2*b->vertexCapacity : INITIAL_WIREFRAME_EDGES;
+		float (*grown)[3] = realloc(m->vertices, b->vertexCapacity*sizeof(*grown));
+		if (grown == NULL) importError(b->fileName, "out of memory");
+		m->vertices = grown;
+	} /*if*/
+	m->vertices[m->noVertices][0] = p[0] + 0.0f;  // +0.0f turns -0 into 0 for welding
+	m->vertices[m->noVertices][1] = p[1] + 0.0f;
+	m->vertices[m->noVertices][2] = p[2] + 0.0f;
+	return m->noVertices++;
+} /* addMeshVertex */
 
-/* rotationMatrixY
-   Sets the matrix outM to contain a 4x4 rotation matrix for a rotation
-   of the given angle (which is provided in radians) around the Y axis.
+/* weldMeshVertex
+   Returns the number of the vertex at exactly p, adding one if there is none.
 */
+int weldMeshVertex(MeshBuilder *b, const float p[3]){
+	IndexedMesh *m = &b->mesh;
+	if (2*(size_t)(m->noVertices + 1) > b->vertexTableSize){
+		b->vertexTableSize = b->vertexTableSize ? 2*b->vertexTableSize : 2*INITIAL_WIREFRAME_EDGES;
+		growTable(b, &b->vertexTable, b->vertexTableSize);
+		int v;
+		for (v=0; v<m->noVertices; v++) {
+			size_t slot = hashBytes(FNV_OFFSET_BASIS, m->vertices[v], sizeof(m->vertices[v])) & (b->vertexTableSize - 1);
+			while (b->vertexTable[slot] >= 0) slot = (slot + 1) & (b->vertexTableSize - 1);
+			b->vertexTable[slot] = v;
+		} /*for*/
+	} /*if*/
 
-void rotationMatrixY(float angle, Matrix outM);
+	float q[3] = {p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f};
+	size_t slot = hashBytes(FNV_OFFSET_BASIS, q, sizeof(q)) & (b->vertexTableSize - 1);
+	while (b->vertexTable[slot] >= 0) {
+		if (memcmp(m->vertices[b->vertexTable[slot]], q, sizeof(q)) == 0) return b->vertexTable[slot];
+		slot = (slot + 1) & (b->vertexTableSize - 1);
+	} /*while*/
+	return b->vertexTable[slot] = addMeshVertex(b, q);
+} /* weldMeshVertex */
 
-/* rotationMatrixZ
-   Sets the matrix outM to contain a 4x4 rotation matrix for a rotation
-   of the given angle (which is provided in radians) around the Z axis.
+/* addMeshEdge
+   Adds the edge between vertices v1 and v2 unless it is already in the mesh,
+   in either direction, or joins a vertex to itself.
+*/
+void addMeshEdge(MeshBuilder *b, int v1, int v2){
+	IndexedMesh *m = &b->mesh;
+	if (v1 < 0 || v2 < 0 || v1 >= m->noVertices || v2 >= m->noVertices)
+		importError(b->fileName, "vertex index out of range");
+	if (v1 == v2) return;
+	int key[2] = {v1 < v2 ? v1 : v2, v1 < v2 ? v2 : v1};
+
+	if (2*(size_t)(m->noEdges + 1) > b->edgeTableSize){
+		b->edgeTableSize = b->edgeTableSize ? 2*b->edgeTableSize : 2*INITIAL_WIREFRAME_EDGES;
+		growTable(b, &b->edgeTable, b->edgeTableSize);
+		int e;
+		for (e=0; e<m->noEdges; e++) {
+			size_t slot = hashBytes(FNV_OFFSET_BASIS, m->edges[e], sizeof(m->edges[e])) & (b->edgeTableSize - 1);
+			while (b->edgeTable[slot] >= 0) slot = (slot + 1) & (b->edgeTableSize - 1);
+			b->edgeTable[slot] = e;
+		} /*for*/
+	} /*if*/
+
+	size_t slot = hashBytes(FNV_OFFSET_BASIS, key, sizeof(key)) & (b->edgeTableSize - 1);
+	while (b->edgeTable[slot] >= 0) {
+		if (memcmp(m->edges[b->edgeTable[slot]], key, sizeof(key)) == 0) return;
+		slot = (slot + 1) & (b->edgeTableSize - 1);
+	} /*while*/
+
+	if (m->noEdges == b->edgeCapacity){
+		if (b->edgeCapacity >= INT32_MAX/2) importError(b->fileName, "too many edges");
+		b->edgeCapacity = b->edgeCapacity ? 2*b->edgeCapacity : INITIAL_WIREFRAME_EDGES;
+		int (*grown)[2] = realloc(m->edges, b->edgeCapacity*sizeof(*grown));
+		if (grown == NULL) importError(b->fileName, "out of memory");
+		m->edges = grown;
+	} /*if*/
+	b->edgeTable[slot] = m->noEdges;
+	memcpy(m->edges[m->noEdges++], key, sizeof(key));
+} /* addMeshEdge */
 
+/* finishMeshBuilder
+   Frees the hash tables of b and hands its mesh over to mesh.
 */
-void rotationMatrixZ(float angle, Matrix outM);
+void finishMeshBuilder(MeshBuilder *b, IndexedMesh *mesh){
+	free(b->vertexTable);
+	free(b->edgeTable);
+	*mesh = b->mesh;
+} /* finishMeshBuilder */
 
-/* scalingMatrix
-   Sets the matrix outM to contain a 4x4 scaling matrix where the three
-   scaling factors are xs, ys, zs.
+/* readImportLine
+   Reads the next line of f into line (of IMPORT_LINE_MAX characters),
+   returning false at the end of the file. Exits on lines too long to hold.
+*/
+bool readImportLine(MeshBuilder *b, FILE *f, char line[]){
+	if (fgets(line, IMPORT_LINE_MAX, f) == NULL) return false;
+	size_t length = strlen(line);
+	if (length == IMPORT_LINE_MAX - 1 && line[length-1] != '\n' && !feof(f))
+		importError(b->fileName, "line too long");
+	return true;
+} /* readImportLine */
 
+/* objIndex
+   Converts the OBJ vertex reference in token, 1-based or negative (counting
+   back from the last vertex), into a vertex number.
 */
-void scalingMatrix(float xs, float ys, float zs, Matrix outM);
+int objIndex(MeshBuilder *b, const char *token){
+	char *end;
+	long index = strtol(token, &end, 10);
+	if (end == token || index == 0) importError(b->fileName, "bad vertex reference");
+	return index > 0 ? (int)(index - 1) : (int)(b->mesh.noVertices + index);
+} /* objIndex */
 
-/* translationMatrix
-   Sets the matrix outM to contain a 4x4 translation matrix where the three
-   translation factors are xt, yt, zt.
+/* importOBJ
+   Reads the vertices (v), faces (f) and polylines (l) of a Wavefront OBJ
+   file. Texture and normal references (v/vt/vn) and all other statements are
+   ignored.
+*/
+void importOBJ(MeshBuilder *b, FILE *f){
+	char line[IMPORT_LINE_MAX];
+	while (readImportLine(b, f, line)) {
+		char *s = line;
+		while (*s == ' ' || *s == '\t') s++;
+		if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')){
+			float p[3];
+			char *end;
+			int i;
+			s += 2;
+			for (i=0; i<3; i++, s=end) {
+				p[i] = strtof(s, &end);
+				if (end == s) importError(b->fileName, "bad vertex");
+			} /*for*/
+			addMeshVertex(b, p);
+		} else if ((s[0] == 'f' || s[0] == 'l') && (s[1] == ' ' || s[1] == '\t')){
+			bool closed = s[0] == 'f';
+			int first = -1, previous = -1;
+			char *token = strtok(s + 2, " \t\r\n");
+			for (; token != NULL; token = strtok(NULL, " \t\r\n")) {
+				int v = objIndex(b, token);
+				if (previous >= 0)
+					addMeshEdge(b, previous, v);
+				else
+					first = v;
+				previous = v;
+			} /*for*/
+			if (closed && previous >= 0) addMeshEdge(b, previous, first);
+		} /*if*/
+	} /*while*/
+} /* importOBJ */
+
+// The storage types of PLY properties
+typedef enum {PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64} PlyType;
+
+typedef struct {
+	char name[PLY_NAME_MAX];
+	PlyType type;        // of the value, or of each item if a list
+	bool list;
+	PlyType countType;   // of the item count, if a list
+} PlyProperty;
+
+typedef struct {
+	char name[PLY_NAME_MAX];
+	long count;
+	PlyProperty properties[PLY_MAX_PROPERTIES];
+	int noProperties;
+} PlyElement;
+
+// The body of a PLY file, read either as whitespace separated text or as
+// binary values of either byte order
+typedef struct {
+	MeshBuilder *builder;
+	FILE *f;
+	bool ascii;
+	bool swap;           // binary, with the other byte order to this machine
+	char line[IMPORT_LINE_MAX];
+	char *cursor;        // next unread text in line, when ascii
+} PlyReader;
 
+/* plyType
+   Returns the PlyType named name, or exits if there is none.
 */
-void translationMatrix(float xt, float yt, float zt, Matrix outM);
+PlyType plyType(MeshBuilder *b, const char *name){
+	static const char *names[][2] = {
+		{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+		{"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}
+	};
+	int t;
+	for (t=PLY_INT8; t<=PLY_FLOAT64; t++)
+		if (strcmp(name, names[t][0]) == 0 || strcmp(name, names[t][1]) == 0) return (PlyType)t;
+	importError(b->fileName, "unknown PLY property type");
+	return PLY_INT8;
+} /* plyType */
 
-/* readWireFrame
-   Reads a wireframe from the file WIREFRAME_INPUT_FILENAME.  The wireframe is
-   returned via parameter wireFrame.  The function returns the number of edges
-   in the wireframe.
+/* plyValue
+   Reads the next value, of the given type, from the body of a PLY file.
 */
-int readWireFrame(Matrix wireFrame[]);
+double plyValue(PlyReader *r, PlyType type){
+	if (r->ascii){
+		while (true) {
+			while (isspace((unsigned char)*r->cursor)) r->cursor++;
+			if (*r->cursor != '\0') break;
+			if (!readImportLine(r->builder, r->f, r->line)) importError(r->builder->fileName, "truncated PLY body");
+			r->cursor = r->line;
+		} /*while*/
+		char *end;
+		double value = strtod(r->cursor, &end);
+		if (end == r->cursor) importError(r->builder->fileName, "bad PLY value");
+		r->cursor = end;
+		return value;
+	} /*if*/
 
-/* matMul
-   Computes the matrix product A*B, which is stored in the matrix C.
-   ARows and ACols contain the number of rows and columns of the matrix A.
-   BCols contains the number of columns in B (the number of rows in B is the same
-   as the number of columns in A).
+	static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+	unsigned char bytes[8];
+	size_t size = sizes[type], i;
+	if (fread(bytes, 1, size, r->f) != size) importError(r->builder->fileName, "truncated PLY body");
+	for (i=0; r->swap && i<size/2; i++) {
+		unsigned char t = bytes[i];
+		bytes[i] = bytes[size - 1 - i];
+		bytes[size - 1 - i] = t;
+	} /*for*/
+	int8_t i8; uint8_t u8; int16_t i16; uint16_t u16; int32_t i32; uint32_t u32; float f32; double f64;
+	switch (type) {
+		case PLY_INT8:    memcpy(&i8, bytes, 1);  return i8;
+		case PLY_UINT8:   memcpy(&u8, bytes, 1);  return u8;
+		case PLY_INT16:   memcpy(&i16, bytes, 2); return i16;
+		case PLY_UINT16:  memcpy(&u16, bytes, 2); return u16;
+		case PLY_INT32:   memcpy(&i32, bytes, 4); return i32;
+		case PLY_UINT32:  memcpy(&u32, bytes, 4); return u32;
+		case PLY_FLOAT32: memcpy(&f32, bytes, 4); return f32;
+		default:          memcpy(&f64, bytes, 8); return f64;
+	} /*switch*/
+} /* plyValue */
+
+/* importPLY
+   Reads a PLY file in any of its three formats. Vertices come from the x, y
+   and z properties of the vertex element; edges from the vertex_indices (or
+   vertex_index) list of each face, and from the vertex1 and vertex2
+   properties of an edge element. Other elements and properties are skipped.
 */
-void matMul(Matrix A, Matrix B, int ARows, int ACols, int BCols, Matrix C){
-	int x,y,z;
-	for(x=0; x<ARows; x++)
-	for(y=0; y<BCols; y++){
-		C[x][y] = 0;
-		for(z=0; z<ACols; z++){
-			C[x][y]+=(A[x][z])*(B[z][y]);
-		}
-	}
-} /* matMul */
+void importPLY(MeshBuilder *b, FILE *f){
+	PlyReader r;
+	r.builder = b;
+	r.f = f;
+	r.cursor = r.line;
+	r.line[0] = '\0';
 
-/* computeTransformationMatrix
-   This function creates matrices for a number of transforms and combines them
-   into a signle transform matriix which is returned in parameter M.
+	PlyElement elements[PLY_MAX_ELEMENTS];
+	int noElements = 0;
+	bool binary = false, bigEndian = false;
+	char *line = r.line;
+	if (!readImportLine(b, f, line) || strncmp(line, "ply", 3) != 0) importError(b->fileName, "not a PLY file");
+	while (true) {
+		if (!readImportLine(b, f, line)) importError(b->fileName, "no end_header");
+		char word[3][PLY_NAME_MAX];
+		int noWords = sscanf(line, "%31s %31s %31s", word[0], word[1], word[2]);
+		if (noWords < 1) continue;
+		if (strcmp(word[0], "end_header") == 0) break;
+		if (strcmp(word[0], "format") == 0 && noWords >= 2){
+			binary = strcmp(word[1], "ascii") != 0;
+			bigEndian = strcmp(word[1], "binary_big_endian") == 0;
+		} else if (strcmp(word[0], "element") == 0 && noWords == 3){
+			if (noElements == PLY_MAX_ELEMENTS) importError(b->fileName, "too many PLY elements");
+			PlyElement *element = &elements[noElements++];
+			snprintf(element->name, PLY_NAME_MAX, "%s", word[1]);
+			element->count = atol(word[2]);
+			element->noProperties = 0;
+		} else if (strcmp(word[0], "property") == 0 && noElements > 0){
+			PlyElement *element = &elements[noElements-1];
+			if (element->noProperties == PLY_MAX_PROPERTIES) importError(b->fileName, "too many PLY properties");
+			PlyProperty *property = &element->properties[element->noProperties++];
+			char type[PLY_NAME_MAX], countType[PLY_NAME_MAX];
+			if (sscanf(line, " property list %31s %31s %31s", countType, type, property->name) == 3){
+				property->list = true;
+				property->countType = plyType(b, countType);
+			} else if (sscanf(line, " property %31s %31s", type, property->name) == 2){
+				property->list = false;
+			} else {
+				importError(b->fileName, "bad PLY property");
+			} /*if*/
+			property->type = plyType(b, type);
+		} /*if*/
+	} /*while*/
 
-   You are to modify this function to include three rotations as follows:
+	const uint16_t probe = 1;
+	bool hostBigEndian = *(const unsigned char *)&probe == 0;
+	r.ascii = !binary;
+	r.swap = binary && bigEndian != hostBigEndian;
+	r.line[0] = '\0';
+	r.cursor = r.line;
 
-   by ROTATION_ANGLE_X about the x axis
-   by ROTATION_ANGLE_Y about the y axis
-   by ROTATION_ANGLE_Y about the z axis
+	int e, p;
+	long item, i;
+	for (e=0; e<noElements; e++) {
+		PlyElement *element = &elements[e];
+		bool isVertex = strcmp(element->name, "vertex") == 0;
+		bool isFace = strcmp(element->name, "face") == 0;
+		bool isEdge = strcmp(element->name, "edge") == 0;
+		for (item=0; item<element->count; item++) {
+			float point[3] = {0, 0, 0};
+			int ends[2] = {-1, -1};
+			for (p=0; p<element->noProperties; p++) {
+				PlyProperty *property = &element->properties[p];
+				if (property->list){
+					long count = (long)plyValue(&r, property->countType);
+					bool indices = isFace && (strcmp(property->name, "vertex_indices") == 0 ||
+					                          strcmp(property->name, "vertex_index") == 0);
+					int first = -1, previous = -1;
+					for (i=0; i<count; i++) {
+						int v = (int)plyValue(&r, property->type);
+						if (!indices) continue;
+						if (previous >= 0)
+							addMeshEdge(b, previous, v);
+						else
+							first = v;
+						previous = v;
+					} /*for*/
+					if (previous >= 0) addMeshEdge(b, previous, first);
+				} else {
+					double value = plyValue(&r, property->type);
+					const char *name = property->name;
+					if (isVertex && name[1] == '\0' && name[0] >= 'x' && name[0] <= 'z')
+						point[name[0] - 'x'] = (float)value;
+					else if (isEdge && strcmp(name, "vertex1") == 0)
+						ends[0] = (int)value;
+					else if (isEdge && strcmp(name, "vertex2") == 0)
+						ends[1] = (int)value;
+				} /*if*/
+			} /*for*/
+			if (isVertex) addMeshVertex(b, point);
+			if (isEdge) addMeshEdge(b, ends[0], ends[1]);
+		} /*for*/
+	} /*for*/
+} /* importPLY */
 
-   The rotations are to apply BEFORE the scaling, translation and projection
-   transformations.
+/* stlFloat
+   Returns the little-endian float at bytes.
+*/
+float stlFloat(const unsigned char bytes[4]){
+	uint32_t u = bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+	float value;
+	memcpy(&value, &u, sizeof(value));
+	return value;
+} /* stlFloat */
 
+/* importSTL
+   Reads the triangles of an STL file. STL lists every triangle's corners
+   separately, so they are welded by position to recover the shared edges.
+   The file is taken to be binary if its size matches the triangle count in
+   its header, and ASCII otherwise. When the size is unknown (compressed
+   input), it is taken to be ASCII if it starts with "solid" and its first
+   facet follows within the length of a binary header.
 */
-void computeTransformationMatrix(Matrix M, float scale, float xt, float yt, float zt) {
-	// returns final transformation in M
-	Matrix P;   // projection matrix
-	Matrix S;   // scaling matrix
-	Matrix T;   // translation matrix
-	Matrix X,Y,Z; //rotation matrices
-	Matrix YZ, XYZ; //resulting matrices
+void importSTL(MeshBuilder *b, FILE *f){
+	unsigned char header[84];
+	struct stat st;
+	bool sized = fileno(f) >= 0 && fstat(fileno(f), &st) == 0;
+	bool binary = fread(header, 1, sizeof(header), f) == sizeof(header);
+	uint32_t noTriangles = 0;
+	int corner[3], i;
+	if (binary){
+		noTriangles = header[80] | (uint32_t)header[81] << 8 | (uint32_t)header[82] << 16 | (uint32_t)header[83] << 24;
+		if (sized){
+			binary = (uint64_t)st.st_size == 84 + 50*(uint64_t)noTriangles;
+		} else {
+			bool facet = false;
+			for (i=0; i+5<=(int)sizeof(header) && !facet; i++)
+				facet = memcmp(&header[i], "facet", 5) == 0;
+			binary = strncmp((const char *)header, "solid", 5) != 0 || !facet;
+		} /*if*/
+	} /*if*/
 
-	rotationMatrixX(ROTATION_ANGLE_X, X);
-	rotationMatrixY(ROTATION_ANGLE_Y, Y);
-	rotationMatrixZ(ROTATION_ANGLE_Z, Z);
-	projectionMatrix(P);
-	scalingMatrix(scale, scale, -scale, S);  // note -scale for z because SVG vertical axis goes downward
-	translationMatrix(xt, yt, zt, T);
+	if (binary){
+		unsigned char batch[IMPORT_STL_BATCH][50];
+		uint32_t done = 0;
+		while (done < noTriangles) {
+			size_t want = noTriangles - done < IMPORT_STL_BATCH ? noTriangles - done : IMPORT_STL_BATCH;
+			if (fread(batch, 50, want, f) != want) importError(b->fileName, "truncated STL file");
+			size_t t;
+			for (t=0; t<want; t++) {
+				for (i=0; i<3; i++) {  // after the 12 byte normal, three corners of 12 bytes
+					float p[3] = {stlFloat(&batch[t][12 + 12*i]), stlFloat(&batch[t][16 + 12*i]),
+					              stlFloat(&batch[t][20 + 12*i])};
+					corner[i] = weldMeshVertex(b, p);
+				} /*for*/
+				addMeshEdge(b, corner[0], corner[1]);
+				addMeshEdge(b, corner[1], corner[2]);
+				addMeshEdge(b, corner[2], corner[0]);
+			} /*for*/
+			done += want;
+		} /*while*/
+		return;
+	} /*if*/
 
-	Matrix SXYZ, TSXYZ;
-	// compute final transformation matrix M using matrix multiplication M = P * T * S * R_X * R_Y * R_Z
-	matMul(Y, Z, 4, 4, 4, YZ);
-	matMul(X,YZ, 4, 4, 4, XYZ);
-	matMul(S, XYZ, 4, 4, 4, SXYZ);
-	matMul(T, SXYZ, 4, 4, 4, TSXYZ);
-	matMul(P, TSXYZ, 2, 4, 4, M);
-} /*computeTransformationMatrix*/
+	rewind(f);
+	char line[IMPORT_LINE_MAX];
+	int noCorners = 0;
+	while (readImportLine(b, f, line)) {
+		float p[3];
+		if (sscanf(line, " vertex %f %f %f", &p[0], &p[1], &p[2]) == 3){
+			if (noCorners < 3) corner[noCorners++] = weldMeshVertex(b, p);
+		} else if (strstr(line, "endloop") != NULL){
+			for (i=0; i<noCorners; i++) addMeshEdge(b, corner[i], corner[(i + 1) % noCorners]);
+			noCorners = 0;
+		} /*if*/
+	} /*while*/
+} /* importSTL */
 
+/* importMesh
+   Reads the OBJ, PLY or STL file fileName, according to format, into mesh.
+   Exits if the file cannot be read or is malformed.
+*/
+void importMesh(const char *fileName, MeshFormat format, IndexedMesh *mesh){
+	FILE *f = openInput(fileName, format == MESH_FORMAT_OBJ ? "r" : "rb");
+	MeshBuilder *b = malloc(sizeof(MeshBuilder));
+	if (b == NULL){
+		closeInput(f);
+		importError(fileName, "out of memory");
+	} /*if*/
+	initMeshBuilder(b, fileName);
 
-void drawWireframe(FILE* outFile, Matrix wireFrame[], int noEdges, Matrix M, char col[]){
-	Matrix R;
-		int edge;
-		for (edge=0; edge<noEdges; edge++) {
-			// transform edge
-			matMul(M, wireFrame[edge], 2, 4, 2, R);
-			// generate SVG for edge
-			writeEdge(outFile, R[0][0], R[1][0], R[0][1], R[1][1], col);
-			printf("%7.2f %7.2f %7.2f %7.2f\n", R[0][0], R[1][0], R[0][1], R[1][1]);
+	// if the import fails, free what it has built before passing the failure on
+	jmp_buf recovery, *outer = loadRecovery;
+	if (outer != NULL && setjmp(recovery) != 0){
+		loadRecovery = outer;
+		closeInput(f);
+		finishMeshBuilder(b, mesh);
+		freeIndexedMesh(mesh);
+		free(b);
+		longjmp(*outer, 1);
+	} /*if*/
+	if (outer != NULL) loadRecovery = &recovery;
+
+	if (format == MESH_FORMAT_OBJ)
+		importOBJ(b, f);
+	else if (format == MESH_FORMAT_PLY)
+		importPLY(b, f);
+	else
+		importSTL(b, f);
+	loadRecovery = outer;
+	closeInput(f);
+	finishMeshBuilder(b, mesh);
+	free(b);
+} /* importMesh */
+
+/* expandIndexedMesh
+   Writes the edges of mesh into a newly allocated array of edge matrices,
+   returned via wireFrame, and returns their number. Their bounding box is
+   returned through bounds.
+*/
+int expandIndexedMesh(IndexedMesh *mesh, Matrix **wireFrame, Bounds *bounds){
+	Matrix *edges = malloc((mesh->noEdges > 0 ? mesh->noEdges : 1)*sizeof(Matrix));
+	if (edges == NULL){
+		int noEdges = mesh->noEdges;
+		freeIndexedMesh(mesh);
+		loadFailed("Out of memory expanding %d edges", noEdges);
+	} /*if*/
+	int edge, end, axis;
+	for (edge=0; edge<mesh->noEdges; edge++) {
+		for (end=0; end<2; end++) {
+			float *p = mesh->vertices[mesh->edges[edge][end]];
+			for (axis=0; axis<3; axis++) edges[edge][axis][end] = p[axis];
+			edges[edge][3][end] = 1;
 		} /*for*/
-}
+		extendBounds(bounds, edges[edge]);
+	} /*for*/
+	*wireFrame = edges;
+	return mesh->noEdges;
+} /* expandIndexedMesh */
 
-/* generateSVGFile
-   This function opens the file HTML5_SVG_OUTPUT_FILENAME for writing
-   and writes the SVG required to display the wireFrame on a web page.
+/* ========================================================================= */
+/*                            Face Reconstruction                            */
+/* ========================================================================= */
+
+#define FACE_MAX_SIDES (6)
+
+// A face found in the edge graph: a chordless cycle of vertices
+typedef struct {
+	int noSides;
+	int v[FACE_MAX_SIDES];
+} Face;
+
+// Candidate faces found by findCycles
+typedef struct {
+	Face *faces;
+	int noFaces;
+	int capacity;
+} FaceList;
+
+/* findCycles
+   Extends the simple path path[0..length-1] in every way that leads to a
+   chordless cycle of at most FACE_MAX_SIDES vertices, adding each cycle to
+   list. Only cycles whose first vertex is their smallest, traversed towards
+   the smaller of its two neighbours, are added, so each is found once.
+*/
+void findCycles(EdgeGraph *g, int path[], int length, FaceList *list){
+	int start = path[0], last = path[length-1], k, i;
+	for (k=g->first[last]; k<g->first[last+1]; k++) {
+		int w = g->neighbour[k];
+		if (w <= start) continue;
+
+		bool usable = true;
+		for (i=1; i<length && usable; i++)
+			if (path[i] == w || (i < length-1 && graphEdge(g, w, path[i]) >= 0)) usable = false;
+		if (!usable) continue;  // revisits the path or would leave a chord
+
+		path[length] = w;
+		if (length+1 >= 3 && graphEdge(g, w, start) >= 0){
+			// w closes the cycle; going on would make (w, start) a chord
+			if (path[1] < w){
+				if (list->noFaces == list->capacity){
+					list->capacity = list->capacity ? 2*list->capacity : 256;
+					Face *grown = realloc(list->faces, list->capacity*sizeof(Face));
+					if (grown == NULL) return;
+					list->faces = grown;
+				} /*if*/
+				Face *face = &list->faces[list->noFaces++];
+				face->noSides = length + 1;
+				memcpy(face->v, path, (length + 1)*sizeof(int));
+			} /*if*/
+		} else if (length+1 < FACE_MAX_SIDES){
+			findCycles(g, path, length + 1, list);
+		} /*if*/
+	} /*for*/
+} /* findCycles */
+
+/* faceNormal
+   Sets n to the normal of face by Newell's method: its length is twice the
+   area of the face and it points the way the face's vertex order turns
+   anticlockwise.
 */
+void faceNormal(IndexedMesh *mesh, Face *face, float n[3]){
+	n[0] = n[1] = n[2] = 0;
+	int i;
+	for (i=0; i<face->noSides; i++) {
+		float *a = mesh->vertices[face->v[i]];
+		float *b = mesh->vertices[face->v[(i + 1) % face->noSides]];
+		n[0] += (a[1] - b[1])*(a[2] + b[2]);
+		n[1] += (a[2] - b[2])*(a[0] + b[0]);
+		n[2] += (a[0] - b[0])*(a[1] + b[1]);
+	} /*for*/
+} /* faceNormal */
 
-void generateSVGfile(Matrix wireFrame[], int noEdges) {
+/* reverseFace
+   Reverses the vertex order of face, flipping its normal.
+*/
+void reverseFace(Face *face){
+	int i;
+	for (i=0; i<face->noSides/2; i++) {
+		int t = face->v[i];
+		face->v[i] = face->v[face->noSides - 1 - i];
+		face->v[face->noSides - 1 - i] = t;
+	} /*for*/
+} /* reverseFace */
 
-	FILE *outFile = fopen(HTML5_SVG_OUTPUT_FILENAME, "w");
-	writePrologue(outFile);
+/* buildFaceAdjacency
+   Rebuilds the faces of a wire frame of noEdges edges from its edge graph g
+   and records the faces either side of each edge in faces. Candidate faces
+   are the chordless cycles of 3 to FACE_MAX_SIDES edges; they are accepted
+   shortest first, as long as none of their edges already has two faces,
+   which recovers the triangles, quads, pentagons and hexagons of a closed
+   mesh. The faces of each connected patch are then oriented consistently
+   across shared edges. A patch is closed if every edge of its faces borders
+   two faces; it is flipped if its normals point inwards (negative signed
+   volume). Only a closed patch has an inside, so the edges of an open patch
+   (a sheet, or a surface with holes) are recorded without faces and are
+   never culled. Returns false if memory runs out, leaving faces empty.
+*/
+bool buildFaceAdjacency(EdgeGraph *g, int noEdges, FaceAdjacency *faces){
+	faces->noFaces = 0;
+	faces->normals = NULL;
+	faces->edgeFaces = NULL;
 
-    Matrix M;   // compute final transformation matrix
-	computeTransformationMatrix(M, 200, 125, 0, 125);
-	drawWireframe(outFile, wireFrame, noEdges, M, OBJECT_COLOR_0);
+	IndexedMesh *mesh = &g->mesh;
+	int noVertices = mesh->noVertices, noDistinct = g->noDistinct;
+	FaceList list = {NULL, 0, 0};
+	int (*sides)[2] = NULL;  // the accepted faces either side of each distinct edge
+	int *queue = NULL;
+	bool *closed = NULL;  // whether each accepted face belongs to a closed patch
+	bool ok = true;
+	int e, v, f;
 
-	computeTransformationMatrix(M, 150, 375, 0, 125);
-	drawWireframe(outFile, wireFrame, noEdges, M, OBJECT_COLOR_1);
+	// find the candidate faces and accept them shortest first
+	if (ok){
+		int path[FACE_MAX_SIDES];
+		for (v=0; v<noVertices; v++) {
+			path[0] = v;
+			findCycles(g, path, 1, &list);
+		} /*for*/
 
-	computeTransformationMatrix(M, 100, 125, 0, 375);
-	drawWireframe(outFile, wireFrame, noEdges, M, OBJECT_COLOR_2);
+		sides = malloc((noDistinct > 0 ? noDistinct : 1)*sizeof(*sides));
+		ok = sides != NULL;
+	} /*if*/
+	if (ok){
+		for (e=0; e<noDistinct; e++) sides[e][0] = sides[e][1] = -1;
+		int length, accepted = 0, i;
+		for (length=3; length<=FACE_MAX_SIDES; length++) {
+			for (f=0; f<list.noFaces; f++) {
+				Face *face = &list.faces[f];
+				if (face->noSides != length) continue;
+				bool free2 = true;
+				for (i=0; i<length && free2; i++)
+					free2 = sides[graphEdge(g, face->v[i], face->v[(i+1) % length])][1] < 0;
+				if (!free2) continue;
+				for (i=0; i<length; i++) {
+					int d = graphEdge(g, face->v[i], face->v[(i+1) % length]);
+					sides[d][sides[d][0] < 0 ? 0 : 1] = accepted;
+				} /*for*/
+				list.faces[accepted++] = *face;  // accepted faces only ever move down
+			} /*for*/
+		} /*for*/
+		list.noFaces = accepted;
 
-	computeTransformationMatrix(M, 50, 375, 0, 375);
-	drawWireframe(outFile, wireFrame, noEdges, M, OBJECT_COLOR_3);
+		queue = malloc((accepted > 0 ? accepted : 1)*sizeof(int));
+		closed = malloc((accepted > 0 ? accepted : 1)*sizeof(bool));
+		faces->normals = malloc((accepted > 0 ? accepted : 1)*sizeof(*faces->normals));
+		faces->edgeFaces = malloc((noEdges > 0 ? noEdges : 1)*sizeof(*faces->edgeFaces));
+		ok = queue != NULL && closed != NULL && faces->normals != NULL && faces->edgeFaces != NULL;
+	} /*if*/
 
-	writeEpilogue(outFile);
+	// orient each patch of faces consistently, then outwards
+	if (ok){
+		bool *seen = calloc(list.noFaces > 0 ? list.noFaces : 1, sizeof(bool));
+		ok = seen != NULL;
+		int head = 0, tail = 0, i, j, side;
+		for (f=0; ok && f<list.noFaces; f++) {
+			if (seen[f]) continue;
+			int patchStart = tail;
+			seen[f] = true;
+			queue[tail++] = f;
+			while (head < tail) {
+				Face *face = &list.faces[queue[head++]];
+				for (i=0; i<face->noSides; i++) {
+					int a = face->v[i], b = face->v[(i+1) % face->noSides];
+					int d = graphEdge(g, a, b);
+					for (side=0; side<2; side++) {
+						int other = sides[d][side];
+						if (other < 0 || seen[other]) continue;
+						// a neighbour must run along the shared edge the other way, b to a
+						Face *next = &list.faces[other];
+						for (j=0; j<next->noSides; j++)
+							if (next->v[j] == a && next->v[(j+1) % next->noSides] == b) reverseFace(next);
+						seen[other] = true;
+						queue[tail++] = other;
+					} /*for*/
+				} /*for*/
+			} /*while*/
 
-	fclose(outFile);
-} /*generateSVGfile*/
+			bool closedPatch = true;
+			for (i=patchStart; closedPatch && i<tail; i++) {
+				Face *face = &list.faces[queue[i]];
+				for (j=0; j<face->noSides && closedPatch; j++)
+					closedPatch = sides[graphEdge(g, face->v[j], face->v[(j+1) % face->noSides])][1] >= 0;
+			} /*for*/
+			for (i=patchStart; i<tail; i++) closed[queue[i]] = closedPatch;
+			if (!closedPatch) continue;
+
+			float centre[3] = {0, 0, 0};
+			int count = 0;
+			for (i=patchStart; i<tail; i++) {
+				Face *face = &list.faces[queue[i]];
+				for (j=0; j<face->noSides; j++, count++) {
+					centre[0] += mesh->vertices[face->v[j]][0];
+					centre[1] += mesh->vertices[face->v[j]][1];
+					centre[2] += mesh->vertices[face->v[j]][2];
+				} /*for*/
+			} /*for*/
+			double volume = 0;
+			for (i=patchStart; i<tail; i++) {
+				Face *face = &list.faces[queue[i]];
+				float n[3];
+				faceNormal(mesh, face, n);
+				float *p = mesh->vertices[face->v[0]];
+				volume += n[0]*(p[0] - centre[0]/count) + n[1]*(p[1] - centre[1]/count) +
+				          n[2]*(p[2] - centre[2]/count);
+			} /*for*/
+			for (i=patchStart; volume<0 && i<tail; i++) reverseFace(&list.faces[queue[i]]);
+		} /*for*/
+		free(seen);
+	} /*if*/
+
+	if (ok){
+		for (f=0; f<list.noFaces; f++) {
+			float *n = faces->normals[f];
+			faceNormal(mesh, &list.faces[f], n);
+			float length = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			if (length > 0){
+				n[0] /= length; n[1] /= length; n[2] /= length;
+			} /*if*/
+		} /*for*/
+		for (e=0; e<noEdges; e++) {
+			int d = g->distinctOf[e];
+			// both faces of an edge lie in the same patch
+			bool culled = d >= 0 && sides[d][0] >= 0 && closed[sides[d][0]];
+			faces->edgeFaces[e][0] = culled ? sides[d][0] : -1;
+			faces->edgeFaces[e][1] = culled ? sides[d][1] : -1;
+		} /*for*/
+		faces->noFaces = list.noFaces;
+	} else {
+		free(faces->normals);
+		free(faces->edgeFaces);
+		faces->normals = NULL;
+		faces->edgeFaces = NULL;
+	} /*if*/
+
+	free(list.faces); free(sides); free(queue); free(closed);
+	return ok;
+} /* buildFaceAdjacency */
+
+/* freeFaceAdjacency
+   Frees the arrays of faces.
+*/
+void freeFaceAdjacency(FaceAdjacency *faces){
+	free(faces->normals);
+	free(faces->edgeFaces);
+	faces->normals = NULL;
+	faces->edgeFaces = NULL;
+	faces->noFaces = 0;
+} /* freeFaceAdjacency */
+
+/* ========================================================================= */
+/*                                  Models                                   */
+/* ========================================================================= */
+
+/* loadModel
+   Reads the wire frame in fileName into model and derives from it whatever
+   the current options call for: spatial reordering, duplicate removal,
+   the edge graph and the connected parts, levels of detail and faces, and
+   finally quantization of the vertices, which replaces the
+   wire frame itself. Like readWireFrame, exits if the file cannot be read.
+*/
+void loadModel(const char *fileName, Model *model){
+	memset(model, 0, sizeof(Model));
+	snprintf(model->name, sizeof(model->name), "%s", fileName);
+	struct stat st;
+	if (stat(fileName, &st) == 0){
+		model->size = st.st_size;
+		model->mtime = st.st_mtim;
+	} /*if*/
+
+	model->noEdges = readWireFrame(fileName, &model->wireFrame, &model->bounds);
+	if (reorderEdges)
+		reorderWireFrame(model->wireFrame, model->noEdges, &model->bounds);
+	if (deduplicateEdges){
+		int noUnique = removeDuplicateEdges(model->wireFrame, model->noEdges);
+		model->noDuplicates = model->noEdges - noUnique;
+		model->noEdges = noUnique;
+		PROFILE_COUNT(COUNTER_EDGES_DUPLICATE, model->noDuplicates);
+	} /*if*/
+	if (cullBackFaces || splitParts)
+		buildEdgeGraph(model->wireFrame, model->noEdges, &model->graph);
+	if (splitParts && model->graph.first != NULL)
+		model->noParts = splitIntoParts(model->wireFrame, model->noEdges, &model->graph, &model->partStart);
+	if (useDetailLevels)
+		buildDetailHierarchy(model->wireFrame, model->noEdges, &model->bounds, &model->lod);
+	if (cullBackFaces && model->graph.first != NULL)
+		buildFaceAdjacency(&model->graph, model->noEdges, &model->faces);
+	if (quantizeVertices && quantizeWireFrame(model->wireFrame, model->noEdges, &model->bounds, &model->quantized)){
+		free(model->wireFrame);
+		model->wireFrame = NULL;
+	} /*if*/
+} /* loadModel */
+
+/* tryLoadModel
+   Loads fileName into model as loadModel does, but returns false, with the
+   reason in loadError and nothing left allocated, instead of exiting if the
+   file cannot be read.
+*/
+bool tryLoadModel(const char *fileName, Model *model){
+	jmp_buf recovery, *outer = loadRecovery;
+	if (setjmp(recovery) != 0){
+		loadRecovery = outer;
+		memset(model, 0, sizeof(Model));
+		return false;
+	} /*if*/
+	loadRecovery = &recovery;
+	loadModel(fileName, model);
+	loadRecovery = outer;
+	return true;
+} /* tryLoadModel */
+
+/* freeModel
+   Frees everything loadModel allocated for model.
+*/
+void freeModel(Model *model){
+	free(model->wireFrame);
+	model->wireFrame = NULL;
+	model->noEdges = 0;
+	freeDetailHierarchy(&model->lod);
+	freeEdgeGraph(&model->graph);
+	free(model->partStart);
+	model->partStart = NULL;
+	model->noParts = 0;
+	freeFaceAdjacency(&model->faces);
+	freeQuantizedMesh(&model->quantized);
+} /* freeModel */
+
+/* ========================================================================= */
+/*                               Render Server                               */
+/* ========================================================================= */
+
+#define SERVER_DEFAULT_PORT (8080)
+#define SERVER_MAX_CLIENTS  (64)
+#define SERVER_MAX_MODELS   (32)
+#define SERVER_REQUEST_MAX  (4096)
+
+// A connection to the server. Once the request has been read, response holds
+// the complete reply, which is written out as the socket accepts it.
+typedef struct {
+	int fd;
+	char request[SERVER_REQUEST_MAX];
+	size_t received;
+	char *response;
+	size_t responseSize;
+	size_t sent;
+} Client;
+
+// Models kept resident by the server, loaded once and shared by every request
+Model modelStore[SERVER_MAX_MODELS];
+int noModels = 0;
+
+/* findModel
+   Returns the resident model for the file fileName, parsing the file the first
+   time it is requested and again whenever it changes on disk. Returns NULL if
+   the file cannot be read or the model store is full; *failed is set if the
+   file was there but could not be loaded, in which case the store, including
+   any earlier copy of the model, is left as it was.
+*/
+Model *findModel(const char *fileName, bool *failed){
+	*failed = false;
+	struct stat st;
+	if (stat(fileName, &st) != 0 || !S_ISREG(st.st_mode) || access(fileName, R_OK) != 0)
+		return NULL;
+
+	Model *model = NULL;
+	int i;
+	for (i=0; i<noModels; i++) {
+		if (strcmp(modelStore[i].name, fileName) == 0){
+			model = &modelStore[i];
+			break;
+		} /*if*/
+	} /*for*/
+	if (model != NULL && model->size == st.st_size &&
+	    model->mtime.tv_sec == st.st_mtim.tv_sec && model->mtime.tv_nsec == st.st_mtim.tv_nsec)
+		return model;
+	if (model == NULL && noModels == SERVER_MAX_MODELS) return NULL;
+
+	// load into a fresh model, so that a file that fails to load leaves the store as it was
+	Model loaded;
+	if (!tryLoadModel(fileName, &loaded)){
+		*failed = true;
+		return NULL;
+	} /*if*/
+	if (model == NULL)
+		model = &modelStore[noModels++];
+	else
+		freeModel(model);
+	*model = loaded;
+	return model;
+} /* findModel */
+
+/* urlDecode
+   Decodes %XX escapes and '+' in the query string component s, in place.
+*/
+void urlDecode(char s[]){
+	char *in = s, *out = s;
+	while (*in != '\0') {
+		unsigned int c;
+		if (*in == '%' && sscanf(in + 1, "%2x", &c) == 1){
+			*out++ = (char)c;
+			in += 3;
+		} else {
+			*out++ = (*in == '+') ? ' ' : *in;
+			in++;
+		} /*if*/
+	} /*while*/
+	*out = '\0';
+} /* urlDecode */
+
+/* setResponse
+   Makes the complete HTTP response, with the given status and body, the reply
+   to client.
+*/
+void setResponse(Client *client, int status, const char *reason, const char *type,
+                 const char *body, size_t bodySize){
+	FILE *f = open_memstream(&client->response, &client->responseSize);
+	if (f == NULL) return;
+	fprintf(f, "HTTP/1.0 %d %s\r\n", status, reason);
+	fprintf(f, "Content-Type: %s\r\n", type);
+	fprintf(f, "Content-Length: %zu\r\n", bodySize);
+	fputs("Connection: close\r\n\r\n", f);
+	fwrite(body, 1, bodySize, f);
+	fclose(f);
+	client->sent = 0;
+} /* setResponse */
 
+/* setError
+   Makes a plain text error message the reply to client.
+*/
+void setError(Client *client, int status, const char *reason){
+	char body[128];
+	int len = snprintf(body, sizeof(body), "%d %s\n", status, reason);
+	setResponse(client, status, reason, "text/plain", body, len);
+} /* setError */
+
+/* validColour
+   Returns whether colour is a colour name, #rgb, #rgba, #rrggbb or #rrggbbaa
+   in hex, or rgb(...) or rgba(...) of numbers. Only these are let through to
+   the page, where colour ends up inside both attributes and scripts.
+*/
+bool validColour(const char colour[]){
+	size_t length = strlen(colour), i;
+	if (colour[0] == '#'){
+		if (length != 4 && length != 5 && length != 7 && length != 9) return false;
+		for (i=1; i<length; i++)
+			if (!isxdigit((unsigned char)colour[i])) return false;
+		return true;
+	} /*if*/
+	size_t open = strncmp(colour, "rgb(", 4) == 0 ? 4 : strncmp(colour, "rgba(", 5) == 0 ? 5 : 0;
+	if (open > 0){
+		if (colour[length-1] != ')') return false;
+		for (i=open; i<length-1; i++)
+			if (!isdigit((unsigned char)colour[i]) && strchr(",. %", colour[i]) == NULL) return false;
+		return true;
+	} /*if*/
+	if (length == 0 || length > 32) return false;
+	for (i=0; i<length; i++)
+		if (!isalpha((unsigned char)colour[i])) return false;
+	return true;
+} /* validColour */
+
+/* handleRequest
+   Renders the reply to a request of the form
+
+     GET /render?model=teapot.txt&rx=20&ry=0&rz=-45&scale=200&format=svg
+
+   model names a wire frame file in the server's working directory. rx, ry and
+   rz are rotations in degrees and default to ROTATION_ANGLE_X/Y/Z. Without
+   scale the server's view list is drawn with those rotations; with it a
+   single view of that scale is centred on the canvas, in colour
+   (OBJECT_COLOR_0 by default), which must pass validColour. With fit=1 each view is fitted to the model's
+   bounding box, as with --autofit.
+   format is html (a complete page, as in HTML5_SVG_OUTPUT_FILENAME), svg, or
+   canvas (a complete page drawn by script, as with --canvas).
+*/
+void handleRequest(Client *client, View defaultViews[], int noDefaultViews){
+	char method[8], target[SERVER_REQUEST_MAX];
+	if (sscanf(client->request, "%7s %4095s", method, target) != 2){
+		setError(client, 400, "Bad Request");
+		return;
+	} /*if*/
+	if (strcmp(method, "GET") != 0){
+		setError(client, 405, "Method Not Allowed");
+		return;
+	} /*if*/
+	char *query = strchr(target, '?');
+	if (query != NULL) *query++ = '\0';
+	if (strcmp(target, "/render") != 0){
+		setError(client, 404, "Not Found");
+		return;
+	} /*if*/
+
+	char *modelName = NULL, *format = "html", *colour = OBJECT_COLOR_0;
+	float rx = ROTATION_ANGLE_X, ry = ROTATION_ANGLE_Y, rz = ROTATION_ANGLE_Z;
+	float scale = 0;
+	bool fit = false;
+	char *save, *param;
+	for (param = strtok_r(query, "&", &save); param != NULL; param = strtok_r(NULL, "&", &save)) {
+		char *value = strchr(param, '=');
+		if (value == NULL) continue;
+		*value++ = '\0';
+		urlDecode(value);
+		if (strcmp(param, "model") == 0) modelName = value;
+		else if (strcmp(param, "format") == 0) format = value;
+		else if (strcmp(param, "colour") == 0) colour = value;
+		else if (strcmp(param, "rx") == 0) rx = atof(value)*(M_PI/180);
+		else if (strcmp(param, "ry") == 0) ry = atof(value)*(M_PI/180);
+		else if (strcmp(param, "rz") == 0) rz = atof(value)*(M_PI/180);
+		else if (strcmp(param, "scale") == 0) scale = atof(value);
+		else if (strcmp(param, "fit") == 0) fit = atoi(value) != 0;
+	} /*for*/
+
+	bool svgOnly = strcmp(format, "svg") == 0, canvas = strcmp(format, "canvas") == 0;
+	if (modelName == NULL || (!svgOnly && !canvas && strcmp(format, "html") != 0) ||
+	    strchr(modelName, '/') != NULL || modelName[0] == '.' || !validColour(colour)){
+		setError(client, 400, "Bad Request");
+		return;
+	} /*if*/
+	bool failed;
+	Model *model = findModel(modelName, &failed);
+	if (model == NULL){
+		if (failed)
+			setError(client, 422, "Unprocessable Entity");
+		else
+			setError(client, 404, "Not Found");
+		return;
+	} /*if*/
+
+	View *viewList = malloc((noDefaultViews > 0 ? noDefaultViews : 1)*sizeof(View));
+	int noViews;
+	if (viewList == NULL){
+		setError(client, 500, "Internal Server Error");
+		return;
+	} /*if*/
+	if (scale > 0){
+		View single = {rx, ry, rz, scale, canvasWidth/2, 0, canvasHeight/2, colour};
+		viewList[0] = single;
+		noViews = 1;
+	} else {
+		for (noViews=0; noViews<noDefaultViews; noViews++) {
+			viewList[noViews] = defaultViews[noViews];
+			viewList[noViews].rx = rx;
+			viewList[noViews].ry = ry;
+			viewList[noViews].rz = rz;
+		} /*for*/
+	} /*if*/
+
+	int view;
+	for (view=0; fit && view<noViews; view++)
+		autoFitView(&viewList[view], &model->bounds);
+
+	char *body = NULL;
+	size_t bodySize = 0;
+	FILE *f = open_memstream(&body, &bodySize);
+	if (f == NULL){
+		free(viewList);
+		setError(client, 500, "Internal Server Error");
+		return;
+	} /*if*/
+	OutputFormat serverFormat = outputFormat;
+	outputFormat = canvas ? OUTPUT_CANVAS : OUTPUT_SVG;
+	standaloneSVG = svgOnly;
+	if (svgOnly)
+		fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%dpx\" height=\"%dpx\">\n",
+		        canvasWidth, canvasHeight);
+	else
+		writeDocumentPrologue(f);
+	drawViews(f, model, viewList, noViews);
+	if (svgOnly)
+		fputs("</svg>\n", f);
+	else
+		writeDocumentEpilogue(f);
+	outputFormat = serverFormat;
+	standaloneSVG = false;
+	fclose(f);
+	free(viewList);
+
+	setResponse(client, 200, "OK", svgOnly ? "image/svg+xml" : "text/html", body, bodySize);
+	free(body);
+} /* handleRequest */
+
+/* serviceClient
+   Reads from or writes to the client, whichever its state calls for. Returns
+   false once the connection is finished and should be closed.
+*/
+bool serviceClient(Client *client, View defaultViews[], int noDefaultViews){
+	if (client->response == NULL){
+		ssize_t n = recv(client->fd, client->request + client->received,
+		                 SERVER_REQUEST_MAX - 1 - client->received, 0);
+		if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+		if (n == 0) return false;
+		client->received += n;
+		client->request[client->received] = '\0';
+		if (strstr(client->request, "\r\n\r\n") != NULL || strstr(client->request, "\n\n") != NULL)
+			handleRequest(client, defaultViews, noDefaultViews);
+		else if (client->received == SERVER_REQUEST_MAX - 1)
+			setError(client, 431, "Request Header Fields Too Large");
+		return client->response != NULL || client->received < SERVER_REQUEST_MAX - 1;
+	} /*if*/
+
+	ssize_t n = send(client->fd, client->response + client->sent,
+	                 client->responseSize - client->sent, 0);
+	if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	client->sent += n;
+	return client->sent < client->responseSize;
+} /* serviceClient */
+
+/* serve
+   Runs the render server on 127.0.0.1:port until it is killed. A single
+   poll() loop accepts connections, reads requests and streams responses, so
+   models are parsed once and then shared by every request. Requests without
+   a scale are drawn with the views in defaultViews.
+*/
+int serve(int port, View defaultViews[], int noDefaultViews){
+	signal(SIGPIPE, SIG_IGN);
+	echoTransformedEdges = false;
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0){
+		printf("Error: Unable to create server socket\n");
+		return EXIT_FAILURE;
+	} /*if*/
+	int on = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0){
+		printf("Error: Unable to listen on port %d\n", port);
+		close(listener);
+		return EXIT_FAILURE;
+	} /*if*/
+	fcntl(listener, F_SETFL, O_NONBLOCK);
+	printf("Serving on http://127.0.0.1:%d/render\n", port);
+	fflush(stdout);
+
+	static Client clients[SERVER_MAX_CLIENTS];
+	struct pollfd fds[SERVER_MAX_CLIENTS + 1];
+	int noClients = 0;
+	while (true) {
+		fds[0].fd = listener;
+		fds[0].events = (noClients < SERVER_MAX_CLIENTS) ? POLLIN : 0;
+		int i;
+		for (i=0; i<noClients; i++) {
+			fds[i+1].fd = clients[i].fd;
+			fds[i+1].events = (clients[i].response == NULL) ? POLLIN : POLLOUT;
+		} /*for*/
+		if (poll(fds, noClients + 1, -1) < 0){
+			if (errno == EINTR) continue;
+			printf("Error: poll failed\n");
+			return EXIT_FAILURE;
+		} /*if*/
+
+		// service existing connections, closing finished ones by moving the last one into their slot
+		for (i=noClients-1; i>=0; i--) {
+			if (fds[i+1].revents == 0) continue;
+			if (serviceClient(&clients[i], defaultViews, noDefaultViews) && !(fds[i+1].revents & (POLLERR | POLLNVAL))) continue;
+			close(clients[i].fd);
+			free(clients[i].response);
+			clients[i] = clients[--noClients];
+		} /*for*/
+
+		if (fds[0].revents & POLLIN) {
+			while (noClients < SERVER_MAX_CLIENTS) {
+				int fd = accept(listener, NULL, NULL);
+				if (fd < 0) break;
+				fcntl(fd, F_SETFL, O_NONBLOCK);
+				Client *client = &clients[noClients++];
+				client->fd = fd;
+				client->received = 0;
+				client->response = NULL;
+				client->responseSize = client->sent = 0;
+			} /*while*/
+		} /*if*/
+	} /*while*/
+} /* serve */
 
 
-int main(){
-	Matrix wireFrame[MAX_WIREFRAME_EDGES];
+#ifndef WIREFRAME_NO_MAIN  // defined by programs that include this file, such as WireFrameBenchmark.c
+int main(int argc, char *argv[]){
+	PROFILE_INIT();
 
-	int noEdges = readWireFrame(wireFrame);
-	generateSVGfile(wireFrame, noEdges);
+	View *viewList = views;
+	int noViews = NUM_VIEWS;
+	int port = -1;  // >= 0 to run the render server
+	bool autoFit = false;
+	const char *inputFileName = WIREFRAME_INPUT_FILENAME;
+	const char *outputFileName = HTML5_SVG_OUTPUT_FILENAME;
+	int arg;
+	for (arg=1; arg<argc; arg++) {
+		if (strcmp(argv[arg], "--serve") == 0){
+			port = SERVER_DEFAULT_PORT;
+			if (arg+1 < argc && isdigit((unsigned char)argv[arg+1][0])) port = atoi(argv[++arg]);
+		} else if (strcmp(argv[arg], "--input") == 0 && arg+1 < argc){
+			inputFileName = argv[++arg];
+		} else if (strcmp(argv[arg], "--output") == 0 && arg+1 < argc){
+			outputFileName = argv[++arg];
+			if (hasCompressedSuffix(outputFileName)) compressOutput = true;
+		} else if (strcmp(argv[arg], "--cache") == 0){
+			useRenderCache = true;
+		} else if (strcmp(argv[arg], "--geometry-cache") == 0){
+			useGeometryCache = true;
+		} else if (strcmp(argv[arg], "--gzip") == 0){
+			compressOutput = true;
+		} else if (strcmp(argv[arg], "--canvas") == 0){
+			outputFormat = OUTPUT_CANVAS;
+		} else if (strcmp(argv[arg], "--share-views") == 0){
+			shareViewGeometry = true;
+		} else if (strcmp(argv[arg], "--group-strokes") == 0){
+			groupStrokes = true;
+		} else if (strcmp(argv[arg], "--views") == 0 && arg+1 < argc){
+			noViews = readViewList(argv[++arg], &viewList);
+		} else if (strcmp(argv[arg], "--autofit") == 0){
+			autoFit = true;
+		} else if (strcmp(argv[arg], "--dedup") == 0){
+			deduplicateEdges = true;
+		} else if (strcmp(argv[arg], "--lod") == 0){
+			useDetailLevels = true;
+		} else if (strcmp(argv[arg], "--cull-subpixel") == 0){
+			cullSubpixelEdges = true;
+		} else if (strcmp(argv[arg], "--cull-back") == 0){
+			cullBackFaces = true;
+		} else if (strcmp(argv[arg], "--morton") == 0){
+			reorderEdges = true;
+		} else if (strcmp(argv[arg], "--merge-collinear") == 0){
+			mergeCollinear = true;
+		} else if (strcmp(argv[arg], "--simplify") == 0){
+			simplifyChains = true;
+		} else if (strcmp(argv[arg], "--parts") == 0){
+			splitParts = true;
+		} else if (strcmp(argv[arg], "--quantize") == 0){
+			quantizeVertices = true;
+		} else {
+			printf("Usage: %s [--input file|-] [--output file|-] [--cache] [--geometry-cache] [--gzip] [--canvas] [--share-views] [--group-strokes] [--views file] [--autofit] [--dedup] [--lod] [--cull-subpixel] [--cull-back] [--morton] [--parts] [--quantize] [--merge-collinear] [--simplify]"
+			       " [--serve [port]]\n", argv[0]);
+			return EXIT_FAILURE;
+		} /*if*/
+	} /*for*/
+	if (port >= 0)
+		return serve(port, viewList, noViews);
+
+	// in a pipeline, keep standard output for the document and reports for standard error
+	bool streamIn = strcmp(inputFileName, STREAM_FILENAME) == 0;
+	bool streamOut = strcmp(outputFileName, STREAM_FILENAME) == 0;
+	FILE *report = streamOut ? stderr : stdout;
+	if (streamIn) setvbuf(stdin, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+	if (streamOut){
+		setvbuf(stdout, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+		echoTransformedEdges = false;
+	} /*if*/
+
+	// with nothing to work out from the whole model first, draw as the edges arrive
+	if (streamIn && noViews > 0 && !autoFit && !deduplicateEdges && !useDetailLevels &&
+	    !cullSubpixelEdges && !cullBackFaces && !shareViewGeometry && !reorderEdges &&
+	    !splitParts && !quantizeVertices && !mergeCollinear && !simplifyChains){
+		streamSVGfile(outputFileName, viewList, noViews);
+		return EXIT_SUCCESS;
+	} /*if*/
+
+	// serve a previous render of the same input and views if there is one
+	uint64_t cacheKey;
+	char scratch[PATH_MAX];
+	bool cacheable = useRenderCache && !streamIn && !streamOut &&
+	                 temporaryPath(scratch, outputFileName) &&  // else a cached copy cannot be put in place
+	                 renderCacheKey(inputFileName, viewList, noViews, autoFit, &cacheKey);
+	if (cacheable && renderCacheFetch(cacheKey, outputFileName))
+		return EXIT_SUCCESS;
+
+	Model model;
+	loadModel(inputFileName, &model);
+	if (deduplicateEdges)
+		fprintf(report, "Removed %d duplicate edges of %d\n", model.noDuplicates, model.noEdges + model.noDuplicates);
+	if (cullBackFaces)
+		fprintf(report, "Rebuilt %d faces\n", model.faces.noFaces);
+	if (splitParts)
+		fprintf(report, "Split into %d parts\n", model.noParts);
+	if (model.wireFrame == NULL)
+		fprintf(report, "Quantized %d vertices: %zu bytes instead of %zu\n", model.quantized.noVertices,
+		        quantizedMeshBytes(&model.quantized), model.noEdges*sizeof(Matrix));
+	int view;
+	for (view=0; autoFit && view<noViews; view++)
+		autoFitView(&viewList[view], &model.bounds);
+	generateSVGfile(outputFileName, &model, viewList, noViews);
+	freeModel(&model);
+
+	if (cacheable) renderCacheStore(cacheKey, outputFileName);
 
 	return EXIT_SUCCESS;
 } /* main */
+#endif /* WIREFRAME_NO_MAIN */
 
 
 /* ========================================================================= */
@@ -244,7 +4334,7 @@ void writePrologue(FILE *f){
 	fputs("<title>CSC 111 Assignment 6 Part II</title>\n", f);
 	fputs("</head>\n", f);
 	fputs("<body>\n", f);
-	fprintf(f,"<svg width=\"%dpx\" height=\"%dpx\">\n", CANVAS_SIZE_X, CANVAS_SIZE_Y);
+	fprintf(f,"<svg width=\"%dpx\" height=\"%dpx\">\n", canvasWidth, canvasHeight);
 } /* writePrologue */
 
 void writeEpilogue(FILE *f){
@@ -302,21 +4392,103 @@ void writeEdge(FILE *f, float x1, float y1, float x2, float y2, char colour[]){
 		printf("writeEdge error: output file == NULL\n");
 		exit(EXIT_FAILURE);
 	} /*if*/
-	fprintf(f,"<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\", y2=\"%.1f\" style=\"stroke: %s;\" />\n",
-			x1, y1, x2, y2, colour);
+	PROFILE_BEGIN(STAGE_EMIT);
+	int written;
+	if (fixedPointOutput && strlen(colour) < EDGE_LINE_MAX/4){
+		char line[EDGE_LINE_MAX];
+		written = formatLine(line, x1, y1, x2, y2, colour);
+		fwrite(line, 1, written, f);
+	} else
+		written = fprintf(f, standaloneSVG ?
+				"<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" style=\"stroke: %s;\" />\n" :
+				"<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\", y2=\"%.1f\" style=\"stroke: %s;\" />\n",
+				x1, y1, x2, y2, colour);
+	PROFILE_END(STAGE_EMIT);
+	PROFILE_COUNT(COUNTER_BYTES_EMITTED, written);
 } /* writeEdge */
 
-int readWireFrame(Matrix wireFrame[]) {
-	FILE *inFile = fopen(WIREFRAME_INPUT_FILENAME, "r");
-	if (inFile == NULL){
-		printf("Error: Unable to open input file %s\n", WIREFRAME_INPUT_FILENAME);
-		exit(EXIT_FAILURE);
+/* parseEdgeFile
+   Opens fileName and parses it with parseWireFrame, closing it again even
+   if parsing fails through loadFailed.
+*/
+int parseEdgeFile(const char *fileName, Matrix **wireFrameOut, Bounds *boundsOut){
+	FILE *inFile = openInput(fileName, "r");
+	jmp_buf recovery, *outer = loadRecovery;
+	if (outer != NULL && setjmp(recovery) != 0){
+		loadRecovery = outer;
+		closeInput(inFile);
+		longjmp(*outer, 1);
+	} /*if*/
+	if (outer != NULL) loadRecovery = &recovery;
+	int noEdges = parseWireFrame(inFile, fileName, wireFrameOut, boundsOut, NULL, NULL);
+	loadRecovery = outer;
+	closeInput(inFile);
+	return noEdges;
+} /* parseEdgeFile */
+
+int readWireFrame(const char *fileName, Matrix **wireFrameOut, Bounds *boundsOut) {
+	PROFILE_BEGIN(STAGE_READ);
+	Bounds scratch;  // used when the caller does not want the bounds
+	if (boundsOut == NULL) boundsOut = &scratch;
+	emptyBounds(boundsOut);
+
+	int edge;
+	if (useGeometryCache){
+		edge = loadGeometrySnapshot(fileName, wireFrameOut, boundsOut);
+		if (edge >= 0){
+			PROFILE_END(STAGE_READ);
+			PROFILE_COUNT(COUNTER_EDGES_SNAPSHOT, edge);
+			return edge;
+		} /*if*/
+	} /*if*/
+
+	MeshFormat format = meshFormat(fileName);
+	if (format != MESH_FORMAT_EDGES){
+		struct stat source;
+		bool snapshot = useGeometryCache && stat(fileName, &source) == 0;
+		IndexedMesh mesh;
+		importMesh(fileName, format, &mesh);
+		edge = expandIndexedMesh(&mesh, wireFrameOut, boundsOut);
+		freeIndexedMesh(&mesh);
+		if (snapshot) saveGeometrySnapshot(fileName, &source, *wireFrameOut, edge);
+		PROFILE_END(STAGE_READ);
+		PROFILE_COUNT(COUNTER_EDGES_PARSED, edge);
+		return edge;
 	} /*if*/
 
+	bool streamIn = strcmp(fileName, STREAM_FILENAME) == 0;
+	struct stat source;
+	bool snapshot = useGeometryCache && !streamIn && stat(fileName, &source) == 0;
+	PROFILE_PAUSE(STAGE_READ);  // parseWireFrame times itself as a call of the stage
+	edge = parseEdgeFile(fileName, wireFrameOut, boundsOut);
+
+	if (snapshot) saveGeometrySnapshot(fileName, &source, *wireFrameOut, edge);
+	return edge;
+} /*readWireFrame*/
+
+int parseWireFrame(FILE *inFile, const char *fileName, Matrix **wireFrameOut, Bounds *boundsOut,
+                   FILE *outFile, View *view) {
+	PROFILE_BEGIN(STAGE_READ);
+	Bounds scratch;  // used when the caller does not want the bounds
+	if (boundsOut == NULL) boundsOut = &scratch;
+	emptyBounds(boundsOut);
+	Matrix M;
+	if (outFile != NULL) computeTransformationMatrix(M, view);
+
+	int capacity = INITIAL_WIREFRAME_EDGES;
+	Matrix *wireFrame = malloc(capacity*sizeof(Matrix));
 	int edge = 0;
 	int noItemsRead;
 
 	while(true) {
+		if (edge == capacity) {  // wireFrame is full
+			capacity *= 2;
+			Matrix *grown = realloc(wireFrame, capacity*sizeof(Matrix));
+			if (grown == NULL) free(wireFrame);
+			wireFrame = grown;
+		} /*if*/
+		if (wireFrame == NULL) loadFailed("Out of memory reading input file %s", fileName);
+
 		noItemsRead = fscanf(inFile, "%f %f %f %f %f %f",
 				             &wireFrame[edge][0][0],
 				             &wireFrame[edge][1][0],
@@ -328,11 +4500,19 @@ int readWireFrame(Matrix wireFrame[]) {
 
 		wireFrame[edge][3][0] = 1;
 		wireFrame[edge][3][1] = 1;
+		extendBounds(boundsOut, wireFrame[edge]);
+		if (outFile != NULL){
+			PROFILE_PAUSE(STAGE_READ);
+			drawWireframe(outFile, &wireFrame[edge], 1, M, view->colour, NULL);
+			PROFILE_RESUME(STAGE_READ);
+		} /*if*/
 		edge++;
-		if(edge == MAX_WIREFRAME_EDGES) break;  // wireFrame is full
 	} /*while*/
 
-	fclose(inFile);
+	*wireFrameOut = wireFrame;
+
+	PROFILE_END(STAGE_READ);
+	PROFILE_COUNT(COUNTER_EDGES_PARSED, edge);
 
 	return edge;
-} /*readWireFrame*/
+} /*parseWireFrame*/
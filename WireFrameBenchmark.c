@@ -0,0 +1,492 @@
+/*
+ *  File name:   WireFrameBenchmark.c
+ *  Description: Benchmarks the stages of WireFrame.c - parsing, transforming (each view in
+ *               full, rotating once then scaling per view as drawViews does, and the
+ *               same from 16-bit quantized vertices, before and after sorting the
+ *               edges into Morton order), building the edge graph, emitting (from
+ *               integer tenths, and with printf for comparison) and the whole
+ *               pipeline end to end - on the bundled models and on synthetic meshes
+ *               built by tiling a bundled model up to a given size. The per-view
+ *               collinear merging and simplification passes are timed on a star of
+ *               edges that all meet at one vertex.
+ *               Each measurement is repeated and reported as its median, 90th and
+ *               99th percentile. The OBJ, PLY and STL importers are then timed on a
+ *               synthetic grid written in each format, and their throughput reported.
+ *
+ *               Build: gcc -O2 -o WireFrameBenchmark WireFrameBenchmark.c -lm
+ *               Usage: ./WireFrameBenchmark [runs] [max synthetic edges]
+ */
+
+#define WIREFRAME_NO_MAIN
+#include "WireFrame.c"
+
+#define BENCHMARK_DEFAULT_RUNS      (15)
+#define BENCHMARK_DEFAULT_MAX_EDGES (1000000)
+// Synthetic meshes with more edges than this are only measured BENCHMARK_LARGE_RUNS times
+#define BENCHMARK_LARGE_MESH        (100000)
+#define BENCHMARK_LARGE_RUNS        (3)
+// The model tiled to make the synthetic meshes, and the file they are written to
+#define BENCHMARK_SYNTHETIC_BASE    ("space_shuttle.txt")
+#define BENCHMARK_SYNTHETIC_FILE    ("benchmark_synthetic.txt")
+// The importers are timed on a grid of this many quads square, written to BENCHMARK_IMPORT_FILE
+#define BENCHMARK_IMPORT_GRID       (400)
+#define BENCHMARK_IMPORT_FILE       ("benchmark_import")
+// The edge passes are timed on a star of this many edges leaving one vertex
+#define BENCHMARK_STAR_EDGES        (50000)
+
+#define NUM_BENCHMARK_MODELS (5)
+char *benchmarkModels[NUM_BENCHMARK_MODELS] = {
+	"cube.txt", "soccer_ball.txt", "teapot.txt", "plane.txt", "space_shuttle.txt"
+};
+
+// Every transformed coordinate is added here so the compiler cannot drop the work
+volatile float benchmarkSink;
+
+/* secondsNow
+   Returns a monotonic time stamp in seconds.
+*/
+double secondsNow(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+} /* secondsNow */
+
+int compareDoubles(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+} /* compareDoubles */
+
+/* percentile
+   Returns the p-th percentile (0 < p <= 1) of the n sorted samples, by nearest rank.
+*/
+double percentile(double sorted[], int n, double p){
+	int rank = (int)ceil(p*n);
+	return sorted[rank > 0 ? rank - 1 : 0];
+} /* percentile */
+
+/* reportStage
+   Sorts the samples (in seconds) of one stage and prints a line of the report.
+*/
+void reportStage(const char *model, int noEdges, const char *stage, double samples[], int runs){
+	qsort(samples, runs, sizeof(double), compareDoubles);
+	double median = percentile(samples, runs, 0.5);
+	printf("%-24s %10d  %-10s %10.3f %10.3f %10.3f %10.1f\n", model, noEdges, stage,
+	       median*1e3, percentile(samples, runs, 0.9)*1e3, percentile(samples, runs, 0.99)*1e3,
+	       noEdges > 0 ? median*1e9/noEdges : 0.0);
+} /* reportStage */
+
+/* timeTransform
+   Returns the time taken to transform every edge for each of the default views.
+*/
+double timeTransform(Matrix wireFrame[], int noEdges){
+	double start = secondsNow();
+	Matrix M, R;
+	float sum = 0;
+	int view, edge;
+	for (view=0; view<NUM_VIEWS; view++) {
+		computeTransformationMatrix(M, &views[view]);
+		for (edge=0; edge<noEdges; edge++) {
+			matMul(M, wireFrame[edge], 2, 4, 2, R);
+			sum += R[0][0] + R[1][0] + R[0][1] + R[1][1];
+		} /*for*/
+	} /*for*/
+	benchmarkSink = sum;
+	return secondsNow() - start;
+} /* timeTransform */
+
+/* timeRotateOnce
+   Returns the time taken to rotate the edges once and scale and offset them
+   for each of the default views, the way drawViews transforms them.
+*/
+double timeRotateOnce(Matrix wireFrame[], int noEdges){
+	double start = secondsNow();
+	RotationBuffer buffer;
+	memset(&buffer, 0, sizeof(RotationBuffer));
+	float sum = 0;
+	int view;
+	for (view=0; view<NUM_VIEWS; view++) {
+		rotateWireFrame(&buffer, wireFrame, noEdges, &views[view]);
+		projectRotated(&buffer, &views[view]);
+		if (noEdges > 0) sum += buffer.projected[noEdges-1][0];
+	} /*for*/
+	freeRotationBuffer(&buffer);
+	benchmarkSink = sum;
+	return secondsNow() - start;
+} /* timeRotateOnce */
+
+/* timeRotateQuantized
+   Returns the time taken to do the same as timeRotateOnce from the
+   quantized mesh, dequantizing inside the rotation.
+*/
+double timeRotateQuantized(QuantizedMesh *mesh){
+	double start = secondsNow();
+	RotationBuffer buffer;
+	memset(&buffer, 0, sizeof(RotationBuffer));
+	float sum = 0;
+	int view;
+	for (view=0; view<NUM_VIEWS; view++) {
+		rotateQuantizedMesh(&buffer, mesh, &views[view]);
+		projectRotated(&buffer, &views[view]);
+		if (mesh->noEdges > 0) sum += buffer.projected[mesh->noEdges-1][0];
+	} /*for*/
+	freeRotationBuffer(&buffer);
+	benchmarkSink = sum;
+	return secondsNow() - start;
+} /* timeRotateQuantized */
+
+/* timeEmit
+   Returns the time taken by writeEdge to write every edge for each of the
+   default views to out. The edges are projected beforehand, outside the timing.
+*/
+double timeEmit(FILE *out, Matrix wireFrame[], int noEdges, float projected[][4]){
+	double elapsed = 0;
+	Matrix M, R;
+	int view, edge;
+	for (view=0; view<NUM_VIEWS; view++) {
+		computeTransformationMatrix(M, &views[view]);
+		for (edge=0; edge<noEdges; edge++) {
+			matMul(M, wireFrame[edge], 2, 4, 2, R);
+			projected[edge][0] = R[0][0]; projected[edge][1] = R[1][0];
+			projected[edge][2] = R[0][1]; projected[edge][3] = R[1][1];
+		} /*for*/
+
+		double start = secondsNow();
+		for (edge=0; edge<noEdges; edge++)
+			writeEdge(out, projected[edge][0], projected[edge][1], projected[edge][2], projected[edge][3],
+			          views[view].colour);
+		fflush(out);
+		elapsed += secondsNow() - start;
+	} /*for*/
+	return elapsed;
+} /* timeEmit */
+
+/* timeEndToEnd
+   Returns the time taken to read fileName and write the complete document to out.
+*/
+double timeEndToEnd(FILE *out, const char *fileName){
+	double start = secondsNow();
+	Model model;
+	loadModel(fileName, &model);
+	writePrologue(out);
+	drawViews(out, &model, views, NUM_VIEWS);
+	writeEpilogue(out);
+	fflush(out);
+	freeModel(&model);
+	return secondsNow() - start;
+} /* timeEndToEnd */
+
+/* benchmarkModel
+   Measures each stage on the model in fileName, runs times, and reports them
+   under the given label.
+*/
+void benchmarkModel(FILE *out, const char *fileName, const char *label, int runs){
+	double *samples = malloc(runs*sizeof(double));
+	Matrix *wireFrame = NULL;
+	int noEdges = 0, run;
+
+	for (run=0; run<runs; run++) {
+		free(wireFrame);
+		double start = secondsNow();
+		noEdges = readWireFrame(fileName, &wireFrame, NULL);
+		samples[run] = secondsNow() - start;
+	} /*for*/
+	reportStage(label, noEdges, "parse", samples, runs);
+
+	for (run=0; run<runs; run++)
+		samples[run] = timeTransform(wireFrame, noEdges);
+	reportStage(label, noEdges, "transform", samples, runs);
+
+	for (run=0; run<runs; run++)
+		samples[run] = timeRotateOnce(wireFrame, noEdges);
+	reportStage(label, noEdges, "rotate+2d", samples, runs);
+
+	Bounds bounds;
+	QuantizedMesh quantized;
+	emptyBounds(&bounds);
+	for (run=0; run<noEdges; run++) extendBounds(&bounds, wireFrame[run]);
+	if (quantizeWireFrame(wireFrame, noEdges, &bounds, &quantized)){
+		for (run=0; run<runs; run++)
+			samples[run] = timeRotateQuantized(&quantized);
+		reportStage(label, noEdges, "quantized", samples, runs);
+		freeQuantizedMesh(&quantized);
+	} /*if*/
+
+	// the same edges in Morton order: the sort itself, then the quantized path over them
+	Matrix *reordered = malloc((noEdges > 0 ? noEdges : 1)*sizeof(Matrix));
+	if (reordered == NULL){
+		printf("Error: Out of memory benchmarking %s\n", fileName);
+		exit(EXIT_FAILURE);
+	} /*if*/
+	for (run=0; run<runs; run++) {
+		memcpy(reordered, wireFrame, noEdges*sizeof(Matrix));
+		double start = secondsNow();
+		reorderWireFrame(reordered, noEdges, &bounds);
+		samples[run] = secondsNow() - start;
+	} /*for*/
+	reportStage(label, noEdges, "morton", samples, runs);
+	if (quantizeWireFrame(reordered, noEdges, &bounds, &quantized)){
+		for (run=0; run<runs; run++)
+			samples[run] = timeRotateQuantized(&quantized);
+		reportStage(label, noEdges, "morton+q", samples, runs);
+		freeQuantizedMesh(&quantized);
+	} /*if*/
+	free(reordered);
+
+	for (run=0; run<runs; run++) {
+		EdgeGraph graph;
+		double start = secondsNow();
+		buildEdgeGraph(wireFrame, noEdges, &graph);
+		samples[run] = secondsNow() - start;
+		freeEdgeGraph(&graph);
+	} /*for*/
+	reportStage(label, noEdges, "graph", samples, runs);
+
+	float (*projected)[4] = malloc((noEdges > 0 ? noEdges : 1)*sizeof(*projected));
+	if (projected == NULL){
+		printf("Error: Out of memory benchmarking %s\n", fileName);
+		exit(EXIT_FAILURE);
+	} /*if*/
+	for (run=0; run<runs; run++)
+		samples[run] = timeEmit(out, wireFrame, noEdges, projected);
+	reportStage(label, noEdges, "emit", samples, runs);
+
+	// the same edges formatted by printf, for comparison
+	bool fixedPoint = fixedPointOutput;
+	fixedPointOutput = false;
+	for (run=0; run<runs; run++)
+		samples[run] = timeEmit(out, wireFrame, noEdges, projected);
+	reportStage(label, noEdges, "printf", samples, runs);
+	fixedPointOutput = fixedPoint;
+	free(projected);
+	free(wireFrame);
+
+	for (run=0; run<runs; run++)
+		samples[run] = timeEndToEnd(out, fileName);
+	reportStage(label, noEdges, "end-to-end", samples, runs);
+
+	free(samples);
+} /* benchmarkModel */
+
+/* writeSyntheticMesh
+   Writes a mesh of exactly noEdges edges to fileName, made by tiling copies
+   of the model in baseName, shrunk to fit, on a cubic grid around the origin.
+*/
+void writeSyntheticMesh(const char *baseName, const char *fileName, int noEdges){
+	Matrix *base;
+	int noBaseEdges = readWireFrame(baseName, &base, NULL);
+	FILE *f = fopen(fileName, "w");
+	if (f == NULL || noBaseEdges == 0){
+		printf("Error: Unable to write synthetic mesh %s\n", fileName);
+		exit(EXIT_FAILURE);
+	} /*if*/
+
+	int copies = (noEdges + noBaseEdges - 1)/noBaseEdges;
+	int grid = (int)ceil(cbrt(copies));
+	float cell = 1.0f/grid;
+	int edge;
+	for (edge=0; edge<noEdges; edge++) {
+		int copy = edge/noBaseEdges;
+		Matrix *e = &base[edge % noBaseEdges];
+		float ox = (copy % grid + 0.5f)*cell - 0.5f;
+		float oy = (copy/grid % grid + 0.5f)*cell - 0.5f;
+		float oz = (copy/(grid*grid) + 0.5f)*cell - 0.5f;
+		fprintf(f, "%.3f %.3f %.3f\t\t%.3f %.3f %.3f\n",
+		        (*e)[0][0]*cell + ox, (*e)[1][0]*cell + oy, (*e)[2][0]*cell + oz,
+		        (*e)[0][1]*cell + ox, (*e)[1][1]*cell + oy, (*e)[2][1]*cell + oz);
+	} /*for*/
+	fclose(f);
+	free(base);
+} /* writeSyntheticMesh */
+
+/* gridPoint
+   Sets p to vertex (i, j) of the synthetic import grid of n quads square: a
+   rippled unit square, so the coordinates are not all short decimals.
+*/
+void gridPoint(int i, int j, int n, float p[3]){
+	p[0] = (float)i/n - 0.5f;
+	p[1] = (float)j/n - 0.5f;
+	p[2] = 0.05f*sinf(12*p[0])*cosf(9*p[1]);
+} /* gridPoint */
+
+/* writeImportGrid
+   Writes the synthetic grid of n quads square to fileName in the given format:
+   OBJ and ASCII PLY with quad faces, binary PLY (little-endian) with quad
+   faces, or binary STL with two triangles per quad.
+*/
+void writeImportGrid(const char *fileName, const char *format, int n){
+	FILE *f = fopen(fileName, "wb");
+	if (f == NULL){
+		printf("Error: Unable to write %s\n", fileName);
+		exit(EXIT_FAILURE);
+	} /*if*/
+	int noVertices = (n + 1)*(n + 1), i, j;
+	float p[3];
+	if (strcmp(format, "stl") == 0){
+		char header[80] = "WireFrameBenchmark grid";
+		uint32_t noTriangles = 2*n*n;
+		fwrite(header, 1, sizeof(header), f);
+		fwrite(&noTriangles, sizeof(noTriangles), 1, f);  // STL is little-endian, like the hosts we run on
+		for (i=0; i<n; i++) {
+			for (j=0; j<n; j++) {
+				float t[2][13];  // normal, three corners, and room for the attribute bytes
+				memset(t, 0, sizeof(t));
+				gridPoint(i, j, n, &t[0][3]);   gridPoint(i+1, j, n, &t[0][6]);   gridPoint(i+1, j+1, n, &t[0][9]);
+				gridPoint(i, j, n, &t[1][3]);   gridPoint(i+1, j+1, n, &t[1][6]); gridPoint(i, j+1, n, &t[1][9]);
+				fwrite(t[0], 50, 1, f);
+				fwrite(t[1], 50, 1, f);
+			} /*for*/
+		} /*for*/
+	} else if (strcmp(format, "obj") == 0){
+		for (i=0; i<=n; i++) {
+			for (j=0; j<=n; j++) {
+				gridPoint(i, j, n, p);
+				fprintf(f, "v %f %f %f\n", p[0], p[1], p[2]);
+			} /*for*/
+		} /*for*/
+		for (i=0; i<n; i++)
+			for (j=0; j<n; j++)
+				fprintf(f, "f %d %d %d %d\n", i*(n+1) + j + 1, (i+1)*(n+1) + j + 1,
+				        (i+1)*(n+1) + j + 2, i*(n+1) + j + 2);
+	} else {
+		bool binary = strcmp(format, "ply-binary") == 0;
+		fprintf(f, "ply\nformat %s 1.0\nelement vertex %d\nproperty float x\nproperty float y\n"
+		        "property float z\nelement face %d\nproperty list uchar int vertex_indices\nend_header\n",
+		        binary ? "binary_little_endian" : "ascii", noVertices, n*n);
+		for (i=0; i<=n; i++) {
+			for (j=0; j<=n; j++) {
+				gridPoint(i, j, n, p);
+				if (binary)
+					fwrite(p, sizeof(float), 3, f);
+				else
+					fprintf(f, "%f %f %f\n", p[0], p[1], p[2]);
+			} /*for*/
+		} /*for*/
+		for (i=0; i<n; i++) {
+			for (j=0; j<n; j++) {
+				int32_t quad[4] = {i*(n+1) + j, (i+1)*(n+1) + j, (i+1)*(n+1) + j + 1, i*(n+1) + j + 1};
+				if (binary){
+					unsigned char sides = 4;
+					fwrite(&sides, 1, 1, f);
+					fwrite(quad, sizeof(int32_t), 4, f);
+				} else {
+					fprintf(f, "4 %d %d %d %d\n", quad[0], quad[1], quad[2], quad[3]);
+				} /*if*/
+			} /*for*/
+		} /*for*/
+	} /*if*/
+	fclose(f);
+} /* writeImportGrid */
+
+/* timeEdgePass
+   Returns the time taken by pass to rewrite the noEdges projected edges to out.
+*/
+double timeEdgePass(EdgePass pass, float projected[][4], int noEdges, float out[][4]){
+	double start = secondsNow();
+	benchmarkSink = pass(projected, noEdges, NULL, out);
+	return secondsNow() - start;
+} /* timeEdgePass */
+
+/* benchmarkStar
+   Times the per-view edge passes, runs times, on a star of noEdges projected
+   edges leaving the centre of the canvas: every chain comes back through the
+   one vertex, where all the edges meet.
+*/
+void benchmarkStar(int noEdges, int runs){
+	double *samples = malloc(runs*sizeof(double));
+	float (*projected)[4] = malloc(noEdges*sizeof(*projected));
+	float (*out)[4] = malloc(noEdges*sizeof(*out));
+	if (samples == NULL || projected == NULL || out == NULL){
+		printf("Error: Out of memory benchmarking a star of %d edges\n", noEdges);
+		exit(EXIT_FAILURE);
+	} /*if*/
+	int edge, run;
+	for (edge=0; edge<noEdges; edge++) {
+		double angle = 2*M_PI*edge/noEdges;
+		projected[edge][0] = CANVAS_SIZE_X/2;
+		projected[edge][1] = CANVAS_SIZE_Y/2;
+		projected[edge][2] = CANVAS_SIZE_X/2 + 0.4*CANVAS_SIZE_X*cos(angle);
+		projected[edge][3] = CANVAS_SIZE_Y/2 + 0.4*CANVAS_SIZE_Y*sin(angle);
+	} /*for*/
+
+	for (run=0; run<runs; run++)
+		samples[run] = timeEdgePass(mergeCollinearEdges, projected, noEdges, out);
+	reportStage("star", noEdges, "merge", samples, runs);
+	for (run=0; run<runs; run++)
+		samples[run] = timeEdgePass(simplifyEdgeChains, projected, noEdges, out);
+	reportStage("star", noEdges, "simplify", samples, runs);
+
+	free(samples); free(projected); free(out);
+} /* benchmarkStar */
+
+/* benchmarkImporters
+   Times importMesh on the synthetic grid in each format, runs times, and
+   reports the median time and the throughput in megabytes and edges per second.
+*/
+void benchmarkImporters(int runs){
+	static const char *formats[] = {"obj", "ply-ascii", "ply-binary", "stl"};
+	static const char *extensions[] = {".obj", ".ply", ".ply", ".stl"};
+	double *samples = malloc(runs*sizeof(double));
+	char fileName[64];
+	int format, run;
+
+	printf("\n%-24s %10s  %-10s %10s %10s %10s\n", "importer", "edges", "size MB", "median ms", "MB/s", "Medges/s");
+	for (format=0; format<4; format++) {
+		snprintf(fileName, sizeof(fileName), "%s%s", BENCHMARK_IMPORT_FILE, extensions[format]);
+		writeImportGrid(fileName, formats[format], BENCHMARK_IMPORT_GRID);
+		struct stat st;
+		stat(fileName, &st);
+
+		IndexedMesh mesh;
+		int noEdges = 0;
+		for (run=0; run<runs; run++) {
+			double start = secondsNow();
+			importMesh(fileName, meshFormat(fileName), &mesh);
+			samples[run] = secondsNow() - start;
+			noEdges = mesh.noEdges;
+			freeIndexedMesh(&mesh);
+		} /*for*/
+		qsort(samples, runs, sizeof(double), compareDoubles);
+		double median = percentile(samples, runs, 0.5);
+		printf("%-24s %10d  %-10.2f %10.3f %10.1f %10.2f\n", formats[format], noEdges, st.st_size/1e6,
+		       median*1e3, st.st_size/1e6/median, noEdges/1e6/median);
+		unlink(fileName);
+	} /*for*/
+	free(samples);
+} /* benchmarkImporters */
+
+int main(int argc, char *argv[]){
+	int runs = argc >= 2 ? atoi(argv[1]) : BENCHMARK_DEFAULT_RUNS;
+	int maxEdges = argc >= 3 ? atoi(argv[2]) : BENCHMARK_DEFAULT_MAX_EDGES;
+	if (runs < 1) runs = 1;
+
+	// measure the pipeline itself: no stdout echo, no snapshots, output discarded
+	echoTransformedEdges = false;
+	useGeometryCache = false;
+	FILE *out = fopen("/dev/null", "w");
+	if (out == NULL){
+		printf("Error: Unable to open /dev/null\n");
+		return EXIT_FAILURE;
+	} /*if*/
+
+	printf("%-24s %10s  %-10s %10s %10s %10s %10s\n",
+	       "model", "edges", "stage", "median ms", "p90 ms", "p99 ms", "ns/edge");
+	int model;
+	for (model=0; model<NUM_BENCHMARK_MODELS; model++)
+		benchmarkModel(out, benchmarkModels[model], benchmarkModels[model], runs);
+
+	int noEdges;
+	for (noEdges=10000; noEdges<=maxEdges; noEdges*=10) {
+		writeSyntheticMesh(BENCHMARK_SYNTHETIC_BASE, BENCHMARK_SYNTHETIC_FILE, noEdges);
+		benchmarkModel(out, BENCHMARK_SYNTHETIC_FILE, "synthetic",
+		               noEdges > BENCHMARK_LARGE_MESH ? BENCHMARK_LARGE_RUNS : runs);
+		if (noEdges > INT32_MAX/10) break;
+	} /*for*/
+	unlink(BENCHMARK_SYNTHETIC_FILE);
+
+	benchmarkStar(BENCHMARK_STAR_EDGES, runs);
+
+	benchmarkImporters(runs);
+
+	fclose(out);
+	return EXIT_SUCCESS;
+} /* main */